@@ -0,0 +1,922 @@
+/*
+ * tinyjson_bench [--json] [group...]
+ *
+ * Runs every benchmark group, or those whose name contains one of the
+ * arguments, so one group at a time gives a meaningful peak RSS. --json
+ * prints one JSON object per result instead of a table, to diff runs across
+ * commits. The corpora are generated here and are the same on every run;
+ * --corpus NAME writes one to stdout.
+ */
+#include "tinyjson.hh"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+/*
+ * Every heap allocation of the process goes through these, so the number of
+ * calls made during a parse is exactly what the parser asked the heap for.
+ * The parallel groups allocate on several threads, hence the atomic.
+ */
+static std::atomic<size_t> alloc_count{0};
+
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) { __libc_free(ptr); }
+}
+#endif
+
+#ifndef BENCH_ITERATIONS
+#define BENCH_ITERATIONS 200
+#endif
+
+static std::string make_payload(int records) {
+  std::string json = "[";
+  for (int i = 0; i < records; i++) {
+    if (i != 0)
+      json += ",";
+    json += "{\"id\":" + std::to_string(i * 7919) +
+            ",\"name\":\"user" + std::to_string(i) +
+            "\",\"active\":" + (i % 3 ? "true" : "false") +
+            ",\"score\":" + std::to_string(i * 0.25) +
+            ",\"tags\":[\"alpha\",\"beta\",\"gamma\"],"
+            "\"address\":{\"city\":\"Springfield\",\"zip\":\"12345\"}}";
+  }
+  json += "]";
+  return json;
+}
+
+static std::string make_strings(int records) {
+  std::string json = "[";
+  for (int i = 0; i < records; i++) {
+    if (i != 0)
+      json += ",";
+    json += "{\"level\":\"info\",\"message\":\"request " +
+            std::to_string(i) +
+            " served from the cache in a reasonable amount of time\","
+            "\"path\":\"/api/v1/users/" +
+            std::to_string(i) + "/profile\"}";
+  }
+  json += "]";
+  return json;
+}
+
+/* base64-looking blobs and long log lines, the worst case for a byte loop */
+static std::string make_long_strings(int records) {
+  static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string json = "[";
+  for (int i = 0; i < records; i++) {
+    if (i != 0)
+      json += ",";
+    json += "\"";
+    for (int j = 0; j < 1024; j++)
+      json += alphabet[(i * 31 + j * 7) % 64];
+    json += "\",\"";
+    for (int j = 0; j < 16; j++)
+      json += "the quick brown fox jumps over the lazy dog ";
+    json += "\"";
+  }
+  json += "]";
+  return json;
+}
+
+/* GeoJSON-style coordinate pairs and 64-bit ids, almost nothing but numbers */
+static std::string make_numbers(int records) {
+  std::string json = "[";
+  char buf[96];
+  uint64_t seed = 88172645463325252ULL;
+  for (int i = 0; i < records; i++) {
+    seed ^= seed << 13, seed ^= seed >> 7, seed ^= seed << 17;
+    if (i != 0)
+      json += ",";
+    std::snprintf(buf, sizeof(buf), "[%.6f,%.6f,%llu,%d]",
+                  (double)(seed % 36000000) / 100000.0 - 180.0,
+                  (double)(seed % 18000000) / 100000.0 - 90.0,
+                  (unsigned long long)seed, (int)(seed % 20000) - 10000);
+    json += buf;
+  }
+  json += "]";
+  return json;
+}
+
+/* Re-indents minified JSON two spaces per level, like most pretty printers. */
+static std::string prettify(const std::string &json) {
+  std::string out;
+  int depth = 0;
+  bool in_string = false;
+  auto newline = [&] {
+    out += '\n';
+    out.append(depth * 2, ' ');
+  };
+  for (size_t i = 0; i < json.size(); i++) {
+    char ch = json[i];
+    if (in_string) {
+      out += ch;
+      if (ch == '\\')
+        out += json[++i];
+      else if (ch == '"')
+        in_string = false;
+      continue;
+    }
+    switch (ch) {
+    case '"':
+      in_string = true;
+      out += ch;
+      break;
+    case '[':
+    case '{':
+      out += ch;
+      depth++;
+      newline();
+      break;
+    case ']':
+    case '}':
+      depth--;
+      newline();
+      out += ch;
+      break;
+    case ',':
+      out += ch;
+      newline();
+      break;
+    case ':':
+      out += ": ";
+      break;
+    default:
+      out += ch;
+    }
+  }
+  return out;
+}
+
+struct Result {
+  double ns;
+  double allocs;
+};
+
+template <typename F> static Result run(F parse_once) {
+  parse_once(); /* warm up */
+  size_t allocs = alloc_count.load(std::memory_order_relaxed);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_ITERATIONS; i++)
+    parse_once();
+  auto stop = std::chrono::steady_clock::now();
+  allocs = alloc_count.load(std::memory_order_relaxed) - allocs;
+  return {
+      std::chrono::duration<double, std::nano>(stop - start).count() /
+          BENCH_ITERATIONS,
+      (double)allocs / BENCH_ITERATIONS,
+  };
+}
+
+static bool json_output = false;
+
+/* the most memory the process has held so far, in KB */
+static long peak_rss() {
+#if defined(__unix__) || defined(__APPLE__)
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+#else
+  return 0;
+#endif
+}
+
+static void report_json(const char *name, size_t bytes, Result r,
+                        size_t nodes) {
+  std::printf("{\"name\":\"%s\",\"bytes\":%zu,\"ns_per_doc\":%.1f,"
+              "\"mb_per_s\":%.2f,\"ns_per_node\":%.3f,"
+              "\"allocs_per_doc\":%.1f,\"peak_rss_kb\":%ld}\n",
+              name, bytes, r.ns, bytes / r.ns * 1e3,
+              nodes != 0 ? r.ns / nodes : 0.0, r.allocs, peak_rss());
+}
+
+/* `nodes` is how many values a document holds, 0 if nobody counted */
+static void report(const char *name, size_t bytes, Result r,
+                   size_t nodes = 0) {
+  if (json_output)
+    return report_json(name, bytes, r, nodes);
+  std::printf("%-24s %10.0f ns/doc %8.1f MB/s %10.1f allocs/doc", name, r.ns,
+              bytes / r.ns * 1e3, r.allocs);
+  if (nodes != 0)
+    std::printf(" %8.2f ns/node %8ld KB peak", r.ns / nodes, peak_rss());
+  std::printf("\n");
+}
+
+static size_t count_nodes(tinyjson::Value &v) {
+  size_t n = 1;
+  if (v.get_type() == tinyjson::Type::ARRAY) {
+    for (tinyjson::Value &e : v.get_array_elems())
+      n += count_nodes(e);
+  } else if (v.get_type() == tinyjson::Type::OBJECT) {
+    for (tinyjson::Member &m : v.get_object_members())
+      n += count_nodes(m.value);
+  }
+  return n;
+}
+
+static void bench_arena() {
+  auto json = std::make_shared<const std::string>(make_payload(1000));
+
+  report("parse/heap", json->size(), run([&] {
+           tinyjson::Value v;
+           v.parse(json);
+         }));
+
+  report("parse/arena", json->size(), run([&] {
+           tinyjson::Document doc;
+           doc.parse(json);
+         }));
+}
+
+static void bench_zero_copy() {
+  auto json = std::make_shared<const std::string>(make_strings(1000));
+  tinyjson::Options options;
+  options.zero_copy = true;
+
+  report("strings/copy", json->size(), run([&] {
+           tinyjson::Value v;
+           v.parse(json);
+         }));
+
+  report("strings/zero_copy", json->size(), run([&] {
+           tinyjson::Value v;
+           v.parse(json, options);
+         }));
+
+  report("strings/zero_copy+arena", json->size(), run([&] {
+           tinyjson::Document doc;
+           doc.parse(json, options);
+         }));
+}
+
+static void report_gbps(const char *name, size_t bytes, Result r) {
+  if (json_output)
+    return report_json(name, bytes, r, 0);
+  std::printf("%-24s %10.0f ns/doc %8.2f GB/s\n", name, r.ns, bytes / r.ns);
+}
+
+static void bench_long_strings() {
+  auto json = std::make_shared<const std::string>(make_long_strings(1000));
+  tinyjson::Options options;
+  options.zero_copy = true;
+
+  report_gbps("long_strings/copy", json->size(), run([&] {
+                tinyjson::Document doc;
+                doc.parse(json);
+              }));
+
+  report_gbps("long_strings/zero_copy", json->size(), run([&] {
+                tinyjson::Document doc;
+                doc.parse(json, options);
+              }));
+}
+
+static void bench_whitespace() {
+  auto minified = std::make_shared<const std::string>(make_payload(1000));
+  auto pretty = std::make_shared<const std::string>(prettify(*minified));
+
+  report("minified", minified->size(), run([&] {
+           tinyjson::Document doc;
+           doc.parse(minified);
+         }));
+
+  report("pretty", pretty->size(), run([&] {
+           tinyjson::Document doc;
+           doc.parse(pretty);
+         }));
+}
+
+static void bench_numbers() {
+  auto json = std::make_shared<const std::string>(make_numbers(20000));
+
+  report("numbers", json->size(), run([&] {
+           tinyjson::Document doc;
+           doc.parse(json);
+         }));
+}
+
+static void bench_structural() {
+  auto records = std::make_shared<const std::string>(make_payload(1000));
+  auto strings = std::make_shared<const std::string>(make_long_strings(1000));
+  tinyjson::Options options;
+  options.engine = tinyjson::ENGINE_STRUCTURAL;
+
+  report("records/structural", records->size(), run([&] {
+           tinyjson::Document doc;
+           doc.parse(records, options);
+         }));
+  report("long_strings/iterative", strings->size(), run([&] {
+           tinyjson::Document doc;
+           doc.parse(strings);
+         }));
+  report("long_strings/structural", strings->size(), run([&] {
+           tinyjson::Document doc;
+           doc.parse(strings, options);
+         }));
+}
+
+/* Records nested `depth` levels deep, the worst case for recursion. */
+static std::string make_nested(int records, int depth) {
+  std::string json = "[";
+  for (int i = 0; i < records; i++) {
+    if (i != 0)
+      json += ",";
+    for (int d = 0; d < depth; d++)
+      json += d % 2 == 0 ? "{\"k\":[" : "[";
+    json += std::to_string(i);
+    for (int d = depth - 1; d >= 0; d--)
+      json += d % 2 == 0 ? "]}" : "]";
+  }
+  json += "]";
+  return json;
+}
+
+static void bench_iterative() {
+  auto records = std::make_shared<const std::string>(make_payload(1000));
+  auto nested = std::make_shared<const std::string>(make_nested(200, 64));
+  tinyjson::Options recursive, iterative;
+  recursive.engine = tinyjson::ENGINE_RECURSIVE;
+  iterative.engine = tinyjson::ENGINE_ITERATIVE;
+
+  report("records/recursive", records->size(), run([&] {
+           tinyjson::Document doc;
+           doc.parse(records, recursive);
+         }));
+  report("records/iterative", records->size(), run([&] {
+           tinyjson::Document doc;
+           doc.parse(records, iterative);
+         }));
+  report("nested/recursive", nested->size(), run([&] {
+           tinyjson::Document doc;
+           doc.parse(nested, recursive);
+         }));
+  report("nested/iterative", nested->size(), run([&] {
+           tinyjson::Document doc;
+           doc.parse(nested, iterative);
+         }));
+}
+
+/* The cheapest useful handler: counts what goes by. */
+struct Counter {
+  size_t values = 0, bytes = 0;
+
+  void on_null() { this->values++; }
+  void on_bool(bool) { this->values++; }
+  void on_number(tinyjson::Value &) { this->values++; }
+  void on_string(std::string_view str) {
+    this->values++;
+    this->bytes += str.size();
+  }
+  void on_key(std::string_view key) { this->bytes += key.size(); }
+  void on_start_array() {}
+  void on_end_array(size_t) { this->values++; }
+  void on_start_object() {}
+  void on_end_object(size_t) { this->values++; }
+};
+
+static void bench_sax() {
+  auto json = std::make_shared<const std::string>(make_payload(1000));
+
+  report("sax/dom", json->size(), run([&] {
+           tinyjson::Document doc;
+           doc.parse(json);
+         }));
+
+  report("sax/counter", json->size(), run([&] {
+           Counter counter;
+           tinyjson::parse_sax(json, counter);
+         }));
+
+  report("sax/builder", json->size(), run([&] {
+           tinyjson::Arena arena;
+           tinyjson::Value root;
+           tinyjson::Builder builder(root, &arena);
+           tinyjson::parse_sax(json, builder);
+         }));
+}
+
+/* The same document arriving in network-sized chunks. */
+static void bench_stream() {
+  std::string json = make_payload(1000);
+  for (size_t chunk : {size_t(1460), size_t(16384)}) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "stream/%zu", chunk);
+    report(name, json.size(), run([&] {
+             tinyjson::Arena arena;
+             tinyjson::Options options;
+             options.arena = &arena;
+             tinyjson::StreamParser sp(options);
+             tinyjson::Value root;
+             size_t used;
+             for (size_t pos = 0; pos < json.size(); pos += chunk)
+               sp.feed(json.data() + pos, std::min(chunk, json.size() - pos),
+                       &used);
+             sp.take(root);
+           }));
+  }
+}
+
+/* Log records one per line, JSON Lines style. */
+static std::string make_lines(int records) {
+  std::string lines;
+  for (int i = 0; i < records; i++) {
+    lines += "{\"ts\":" + std::to_string(1700000000000LL + i * 37) +
+             ",\"level\":\"info\",\"msg\":\"request " + std::to_string(i) +
+             " done\",\"tags\":[\"api\",\"v1\"],\"ms\":" +
+             std::to_string(i % 250) + "." + std::to_string(i % 10) + "}\n";
+  }
+  return lines;
+}
+
+/* The same records parsed on 1 to N threads. */
+static void bench_lines() {
+  auto json = std::make_shared<const std::string>(make_lines(20000));
+  unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned threads = 1; threads <= std::max(4u, cores); threads *= 2) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "lines/%u_threads", threads);
+    tinyjson::Batch batch;
+    report(name, json->size(), run([&] { batch.parse(json, threads); }));
+  }
+}
+
+/* One large top-level array split between 1 to N threads. */
+static void bench_parallel() {
+  auto json = std::make_shared<const std::string>(make_payload(20000));
+  unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned threads = 1; threads <= std::max(4u, cores); threads *= 2) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "parallel/%u_threads", threads);
+    tinyjson::Options options;
+    options.threads = threads;
+    report(name, json->size(), run([&] {
+             tinyjson::Document doc;
+             doc.parse(json, options);
+           }));
+  }
+}
+
+/*
+ * A file read into a string first, against the file mapped in place. Both
+ * borrow their strings from the text, so only the reading differs.
+ */
+static void bench_file() {
+  const char *path = "tinyjson_bench_file.json";
+  std::string json = make_payload(20000);
+  std::FILE *f = std::fopen(path, "wb");
+  std::fwrite(json.data(), 1, json.size(), f);
+  std::fclose(f);
+
+  tinyjson::Options options;
+  options.zero_copy = true;
+  report("file/read", json.size(), run([&] {
+           std::FILE *in = std::fopen(path, "rb");
+           auto text = std::make_shared<std::string>(json.size(), '\0');
+           text->resize(std::fread(text->data(), 1, text->size(), in));
+           std::fclose(in);
+           tinyjson::Document doc;
+           doc.parse(text, options);
+         }));
+  report("file/mmap", json.size(), run([&] {
+           tinyjson::Document doc;
+           doc.parse_file(path, options);
+         }));
+  std::remove(path);
+}
+
+static void bench_stringify() {
+  struct {
+    const char *name;
+    std::string json;
+  } corpora[] = {
+      {"stringify/records", make_payload(1000)},
+      {"stringify/strings", make_strings(5000)},
+      {"stringify/numbers", make_numbers(20000)},
+  };
+  for (auto &corpus : corpora) {
+    tinyjson::Document doc;
+    doc.parse(std::make_shared<const std::string>(corpus.json));
+    tinyjson::Context c;
+    size_t len = 0;
+    Result r = run([&] { c.stringify(doc.root, &len); });
+    report(corpus.name, len, r);
+  }
+}
+
+/* Log-style records whose keys are all too long to be stored inline. */
+static std::string make_events(int records) {
+  std::string json = "[";
+  for (int i = 0; i < records; i++) {
+    if (i != 0)
+      json += ",";
+    json += "{\"event_timestamp\":" + std::to_string(1700000000 + i) +
+            ",\"customer_identifier\":" + std::to_string(i % 97) +
+            ",\"event_category\":\"checkout_completed\""
+            ",\"payment_method\":\"credit_card_visa\"}";
+  }
+  json += "]";
+  return json;
+}
+
+static void bench_intern() {
+  auto json = std::make_shared<const std::string>(make_events(2000));
+  tinyjson::InternPool pool;
+  tinyjson::Options options;
+  options.intern = &pool;
+
+  report("events/copy", json->size(), run([&] {
+           tinyjson::Value v;
+           v.parse(json);
+         }));
+
+  report("events/intern", json->size(), run([&] {
+           tinyjson::Value v;
+           v.parse(json, options);
+         }));
+
+  options.intern_values = true;
+  report("events/intern_values", json->size(), run([&] {
+           tinyjson::Value v;
+           v.parse(json, options);
+         }));
+}
+
+/*
+ * A 10 KB record of which a handler reads four fields: most of it is an
+ * array of line items and a metadata object nobody looks at.
+ */
+static std::string make_record() {
+  std::string json = "{\"id\":123456,\"items\":[";
+  for (int i = 0; i < 80; i++) {
+    if (i != 0)
+      json += ",";
+    json += "{\"sku\":\"SKU-" + std::to_string(i * 31) +
+            "\",\"qty\":" + std::to_string(i % 7) +
+            ",\"price\":" + std::to_string(i * 1.25) +
+            ",\"tags\":[\"a\",\"b\"]}";
+  }
+  json += "],\"meta\":{\"notes\":\"" + std::string(2000, 'n') +
+          "\",\"flags\":[true,false,null]},"
+          "\"user\":{\"id\":42,\"name\":\"Ada\"},\"status\":\"paid\"}";
+  return json;
+}
+
+static void bench_cursor() {
+  auto json = std::make_shared<const std::string>(make_record());
+
+  report("fields/dom", json->size(), run([&] {
+           tinyjson::Document doc;
+           doc.parse(json);
+           tinyjson::Value *user = doc.root.find_member("user");
+           doc.root.find_member("id")->get_int64();
+           user->find_member("id")->get_int64();
+           user->find_member("name")->get_string();
+           doc.root.find_member("status")->get_string();
+         }));
+
+  report("fields/cursor", json->size(), run([&] {
+           tinyjson::Cursor doc(*json);
+           tinyjson::Cursor user = doc["user"];
+           doc["id"].get_int64();
+           user["id"].get_int64();
+           user["name"].get_string();
+           doc["status"].get_string();
+         }));
+}
+
+/* Many small documents in a row, as a request handler sees them. */
+static void bench_parser() {
+  std::string json = make_record();
+
+  report("small/value", json.size(), run([&] {
+           tinyjson::Value v;
+           v.parse(json);
+         }));
+  report("small/document", json.size(), run([&] {
+           tinyjson::Document doc;
+           doc.parse(json.data(), json.size());
+         }));
+  tinyjson::Parser parser;
+  report("small/parser", json.size(), run([&] { parser.parse(json); }));
+  tinyjson::Recycler recycler;
+  tinyjson::Value v;
+  report("small/parse_into", json.size(),
+         run([&] { v.parse_into(json, recycler); }));
+}
+
+/* Loading a cached document: text against the binary encoding of it. */
+static void bench_binary() {
+  std::string json = make_payload(1000);
+  tinyjson::Value tree;
+  tree.parse(json);
+  tinyjson::BinaryDocument doc;
+  doc.encode(tree);
+  std::string bytes(doc.get_data(), doc.get_size());
+
+  report("binary/parse_text", json.size(), run([&] {
+           tinyjson::Document text;
+           text.parse(json.data(), json.size());
+         }));
+  report("binary/open", json.size(), run([&] {
+           tinyjson::BinaryDocument view;
+           view.open(bytes.data(), bytes.size());
+           view.get_root().get_type();
+         }));
+  report("binary/validate", json.size(), run([&] {
+           tinyjson::BinaryDocument view;
+           view.open(bytes.data(), bytes.size());
+           view.validate();
+         }));
+  report("binary/encode", json.size(), run([&] { doc.encode(tree); }));
+  report("binary/from_text", json.size(),
+         run([&] { doc.parse(json.data(), json.size()); }));
+  report("binary/to_text", json.size(), run([&] { doc.stringify(); }));
+  report("binary/to_tree", json.size(), run([&] {
+           tinyjson::Arena arena;
+           tinyjson::Value v;
+           doc.get_root().get_value(v, &arena);
+         }));
+  if (json_output)
+    std::printf("{\"name\":\"binary/size\",\"bytes\":%zu,"
+                "\"bytes_encoded\":%zu}\n",
+                json.size(), bytes.size());
+  else
+    std::printf("binary: %zu bytes of text, %zu encoded\n", json.size(),
+                bytes.size());
+}
+
+static size_t count_nodes(const tinyjson::TapeValue &v) {
+  size_t n = 1;
+  tinyjson::Type type = v.get_type();
+  if (type == tinyjson::Type::ARRAY || type == tinyjson::Type::OBJECT) {
+    for (tinyjson::TapeValue e : v)
+      n += count_nodes(e);
+  }
+  return n;
+}
+
+/* One contiguous tape against the tree: parsing, a full walk and a skip. */
+static void bench_tape() {
+  std::string json = make_payload(1000);
+  tinyjson::Document doc;
+  doc.parse(json.data(), json.size());
+  tinyjson::Tape tape;
+  tape.parse(json);
+  size_t nodes = count_nodes(doc.root);
+
+  report("tape/parse_tree", json.size(), run([&] {
+           tinyjson::Document d;
+           d.parse(json.data(), json.size());
+         }), nodes);
+  report("tape/parse_tape", json.size(), run([&] { tape.parse(json); }),
+         nodes);
+  report("tape/walk_tree", json.size(), run([&] { count_nodes(doc.root); }),
+         nodes);
+  report("tape/walk_tape", json.size(),
+         run([&] { count_nodes(tape.get_root()); }), nodes);
+  /* the last element, stepping over every one before it */
+  report("tape/skip", json.size(), run([&] {
+           tinyjson::TapeValue root = tape.get_root();
+           size_t n = root.get_type() == tinyjson::Type::ARRAY
+                          ? root.get_array_size()
+                          : root.get_object_size();
+           if (root.get_type() == tinyjson::Type::ARRAY)
+             root.get_array_elem(n - 1);
+         }));
+}
+
+/* The ETL pattern: a few paths, one of them through every line item. */
+static void bench_projection() {
+  auto json = std::make_shared<const std::string>(make_record());
+
+  report("project/dom", json->size(), run([&] {
+           tinyjson::Document doc;
+           doc.parse(json);
+           doc.root.find_member("id")->get_int64();
+           doc.root.find_member("user")->find_member("id")->get_int64();
+           tinyjson::Value *items = doc.root.find_member("items");
+           for (size_t i = 0; i < items->get_array_size(); i++)
+             items->get_array_elem(i)->find_member("price")->get_number();
+         }));
+
+  tinyjson::Projection proj;
+  proj.add("/id");
+  proj.add("/user/id");
+  proj.add("/items/*/price");
+  tinyjson::Arena arena;
+  tinyjson::Options options;
+  options.arena = &arena;
+  report("project/projection", json->size(), run([&] {
+           tinyjson::Value out;
+           proj.extract(*json, out, options);
+           out.release();
+           arena.clear();
+         }));
+}
+
+/* Lookup cost against object width, the hash index against a plain scan. */
+static void bench_find_member() {
+  for (int width : {4, 16, 64, 256, 1024}) {
+    std::string json = "{";
+    std::vector<std::string> keys;
+    for (int i = 0; i < width; i++) {
+      keys.push_back("field_" + std::to_string(i * 7919));
+      json += (i ? ",\"" : "\"") + keys.back() + "\":" + std::to_string(i);
+    }
+    json += "}";
+    tinyjson::Document doc;
+    doc.parse(std::make_shared<const std::string>(json));
+    tinyjson::Value &v = doc.root;
+
+    size_t found = 0;
+    Result hashed = run([&] {
+      for (auto &key : keys)
+        found += v.find_member(key) != nullptr;
+    });
+    Result scanned = run([&] {
+      for (auto &key : keys) {
+        for (size_t i = 0; i < v.get_object_size(); i++) {
+          if (v.get_object_key_view(i) == key) {
+            found++;
+            break;
+          }
+        }
+      }
+    });
+    if (json_output)
+      std::printf("{\"name\":\"find_member/%d\",\"ns_per_lookup\":%.2f,"
+                  "\"ns_per_scan\":%.2f}\n",
+                  width, hashed.ns / width, scanned.ns / width);
+    else
+      std::printf("find_member/%-12d %10.1f ns/lookup %10.1f ns/scan\n",
+                  width, hashed.ns / width, scanned.ns / width);
+  }
+}
+
+/*
+ * A country outline the way canada.json stores it: one polygon of rings of
+ * [longitude, latitude] pairs printed to full double precision.
+ */
+static std::string make_canada(int rings, int points) {
+  std::string json = "{\"type\":\"FeatureCollection\",\"features\":[{"
+                     "\"type\":\"Feature\",\"properties\":{\"name\":"
+                     "\"Canada\"},\"geometry\":{\"type\":\"Polygon\","
+                     "\"coordinates\":[";
+  char buf[64];
+  uint64_t seed = 2463534242ULL;
+  for (int r = 0; r < rings; r++) {
+    json += r != 0 ? ",[" : "[";
+    for (int p = 0; p < points; p++) {
+      seed ^= seed << 13, seed ^= seed >> 7, seed ^= seed << 17;
+      std::snprintf(buf, sizeof(buf), "%s[%.17g,%.17g]", p != 0 ? "," : "",
+                    -141.0 + (double)(seed % 8800000) / 100000.0,
+                    41.6 + (double)(seed >> 40) / (double)(1 << 24) * 41.5);
+      json += buf;
+    }
+    json += "]";
+  }
+  json += "]}}]}";
+  return json;
+}
+
+/* One object with `width` members, like a lookup table or a sparse record. */
+static std::string make_wide(int width) {
+  std::string json = "{";
+  for (int i = 0; i < width; i++) {
+    json += (i != 0 ? ",\"" : "\"") + std::string("key_") +
+            std::to_string(i * 2654435761u % 1000003) +
+            "\":" + std::to_string(i);
+  }
+  json += "}";
+  return json;
+}
+
+static const struct {
+  const char *name;
+  std::string (*make)();
+} corpora[] = {
+    {"strings", [] { return make_strings(5000); }},
+    {"canada", [] { return make_canada(480, 100); }},
+    {"nested", [] { return make_nested(200, 64); }},
+    {"wide", [] { return make_wide(20000); }},
+    {"minified", [] { return make_payload(1000); }},
+    {"pretty", [] { return prettify(make_payload(1000)); }},
+    {"ndjson", [] { return make_lines(20000); }},
+};
+
+/* Every corpus through the default parser, with the cost of each value. */
+static void bench_corpora() {
+  for (auto &corpus : corpora) {
+    auto json = std::make_shared<const std::string>(corpus.make());
+    std::string name = std::string("corpus/") + corpus.name;
+    size_t nodes = 0;
+    if (std::strcmp(corpus.name, "ndjson") == 0) {
+      tinyjson::Batch batch;
+      batch.parse(json, 1);
+      for (auto &v : batch.values)
+        nodes += count_nodes(v);
+      report(name.c_str(), json->size(), run([&] { batch.parse(json, 1); }),
+             nodes);
+      continue;
+    }
+    tinyjson::Document doc;
+    doc.parse(json);
+    nodes = count_nodes(doc.root);
+    report(name.c_str(), json->size(), run([&] {
+             tinyjson::Document doc;
+             doc.parse(json);
+           }),
+           nodes);
+  }
+}
+
+static const struct {
+  const char *name;
+  void (*run)();
+} groups[] = {
+    {"corpora", bench_corpora},
+    {"arena", bench_arena},
+    {"zero_copy", bench_zero_copy},
+    {"long_strings", bench_long_strings},
+    {"whitespace", bench_whitespace},
+    {"numbers", bench_numbers},
+    {"structural", bench_structural},
+    {"iterative", bench_iterative},
+    {"sax", bench_sax},
+    {"stream", bench_stream},
+    {"lines", bench_lines},
+    {"parallel", bench_parallel},
+    {"file", bench_file},
+    {"stringify", bench_stringify},
+    {"find_member", bench_find_member},
+    {"intern", bench_intern},
+    {"parser", bench_parser},
+    {"cursor", bench_cursor},
+    {"binary", bench_binary},
+    {"tape", bench_tape},
+    {"projection", bench_projection},
+};
+
+int main(int argc, char **argv) {
+  std::vector<const char *> filters;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--json") == 0) {
+      json_output = true;
+    } else if (std::strcmp(argv[i], "--corpus") == 0 && i + 1 < argc) {
+      for (auto &corpus : corpora) {
+        if (std::strcmp(corpus.name, argv[i + 1]) == 0) {
+          std::string json = corpus.make();
+          std::fwrite(json.data(), 1, json.size(), stdout);
+          return 0;
+        }
+      }
+      std::fprintf(stderr, "no corpus named %s\n", argv[i + 1]);
+      return 1;
+    } else {
+      filters.push_back(argv[i]);
+    }
+  }
+  for (auto &group : groups) {
+    bool selected = filters.empty();
+    for (const char *filter : filters)
+      selected = selected || std::strstr(group.name, filter) != nullptr;
+    if (selected)
+      group.run();
+  }
+  return 0;
+}
@@ -1,14 +1,22 @@
 #ifndef _TINYJSON_H_
 #define _TINYJSON_H_
 
+#include <atomic>
 #include <cassert>
 #include <cerrno>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <string>
+#include <span>
+#include <string_view>
+#include <vector>
 
 namespace tinyjson {
 
@@ -16,7 +24,31 @@ enum Error {
   NON_STRING = -1,
 };
 
-enum Type { NIL, FALSE, TRUE, NUMBER, STRING, ARRAY, OBJECT };
+enum Type : uint8_t { NIL, FALSE, TRUE, NUMBER, STRING, ARRAY, OBJECT };
+
+/* how a NUMBER is stored */
+enum Number : uint8_t {
+  NUMBER_DOUBLE,
+  /* integer literals that fit in int64_t */
+  NUMBER_INT64,
+  /* positive integer literals above INT64_MAX that fit in uint64_t */
+  NUMBER_UINT64,
+};
+
+enum Flag : uint8_t {
+  /* storage is owned by an Arena, so nothing is freed on release */
+  FLAG_ARENA = 1 << 0,
+  /* string bytes live in Value::ss */
+  FLAG_INLINE = 1 << 1,
+  /* string bytes point into the input and are not owned */
+  FLAG_BORROWED = 1 << 2,
+  /* string bytes are still JSON-escaped, decoded on first access */
+  FLAG_ESCAPED = 1 << 3,
+  /* a hash index of the keys follows the members */
+  FLAG_HASHED = 1 << 4,
+  /* heap storage rounded up to a Recycler size class */
+  FLAG_POOLED = 1 << 5,
+};
 
 enum Parse {
   OK = 0,
@@ -33,124 +65,1248 @@ enum Parse {
   INVALID_STRING_CHAR,
   INVALID_UNICODE_HEX,
   INVALID_UNICODE_SURROGATE,
+  /* arrays and objects are nested deeper than Options::max_depth */
+  NESTING_TOO_DEEP,
+  /* the file to parse could not be opened or read */
+  FILE_ERROR,
+  /* the bytes are not a binary document, see BinaryDocument */
+  INVALID_BINARY,
+  /*
+   * a string, array or object is too long for the 32-bit length of a Value,
+   * the document too long for the 32-bit offsets of a Tape, or a
+   * StreamParser token longer than Options::max_token
+   */
+  DOCUMENT_TOO_LARGE,
 };
 
+class Value;
 class Member;
+class Context;
+class BinaryValue;
+class TapeValue;
+
+/*
+ * Arena is a bump allocator for everything a parse produces: nodes, child
+ * arrays and string bytes. Nothing is freed one by one; clear() or the
+ * destructor releases every block at once.
+ */
+class Arena {
+private:
+  struct Block {
+    Block *next;
+    size_t size;
+  };
+
+  Block *head;
+  char *cur, *end;
+  size_t block_size;
+
+  void *alloc_slow(size_t size, size_t align);
+
+public:
+  Arena() noexcept;
+  ~Arena();
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  inline void *alloc(size_t size, size_t align = alignof(double)) {
+    uintptr_t p = ((uintptr_t)this->cur + align - 1) & ~(uintptr_t)(align - 1);
+    if (this->cur == nullptr || p + size > (uintptr_t)this->end)
+      return this->alloc_slow(size, align);
+    this->cur = (char *)(p + size);
+    return (void *)p;
+  }
+  void clear();
+  /*
+   * Forgets everything allocated but keeps the memory, merged into one
+   * block, so filling the arena the same way again allocates nothing.
+   */
+  void reset();
+  /* takes over every block of `other`, which is left empty */
+  void adopt(Arena &other);
 
+  size_t get_block_count();
+  size_t get_capacity();
+};
+
+/*
+ * An InternPool keeps a single immutable copy of every string put in it, so
+ * documents parsed with one share their repeated keys instead of each
+ * holding its own. Equal strings from one pool are the same pointer. The
+ * pool must outlive every value that refers to it.
+ */
+class InternPool {
+private:
+  struct Slot {
+    const char *str;
+    uint32_t len;
+    uint32_t hash;
+  };
+
+  Arena strings;
+  Slot *slots;
+  size_t count, capacity;
+  std::mutex lock;
+
+  void grow();
+
+public:
+  InternPool() noexcept;
+  ~InternPool();
+  InternPool(const InternPool &) = delete;
+  InternPool &operator=(const InternPool &) = delete;
+
+  /* the pooled copy of `str`, added first if it is new */
+  std::string_view intern(std::string_view str);
+  /* the same, for pools several threads intern into at once */
+  std::string_view intern_shared(std::string_view str);
+  /* forgets every string; values still pointing at them dangle */
+  void clear();
+
+  size_t get_size();
+};
+
+/*
+ * A Recycler holds heap blocks taken from trees that are no longer needed,
+ * filed by size class, and hands them out again before asking malloc. Parsing
+ * with one rounds every child array and string up to its class, so a block
+ * fits any later node of the same class. Blocks still held are freed with the
+ * recycler. Not thread-safe.
+ */
+class Recycler {
+private:
+  /* four classes per power of two, from 16 bytes up */
+  static constexpr size_t CLASSES = 4 * 60;
+
+  /* each free block starts with a pointer to the next one of its class */
+  void *lists[CLASSES];
+  size_t count, capacity, mallocs;
+  /* the scratch stack of Value::parse_into(), kept between parses */
+  std::unique_ptr<Context> c;
+
+  friend class Value;
+
+  void put(void *block, size_t capacity);
+
+public:
+  Recycler() noexcept;
+  ~Recycler();
+  Recycler(const Recycler &) = delete;
+  Recycler &operator=(const Recycler &) = delete;
+
+  /* at least `size` bytes, all of the size class it rounds up to */
+  void *alloc(size_t size);
+  /* keeps the heap blocks of `v` and everything under it; `v` becomes NIL */
+  void take(Value &v);
+  void clear();
+
+  /* blocks held and the bytes in them */
+  size_t get_block_count();
+  size_t get_capacity();
+  /* blocks alloc() had to get from malloc */
+  size_t get_malloc_count();
+};
+
+enum Engine : uint8_t {
+  /* one recursive descent over the bytes */
+  ENGINE_RECURSIVE,
+  /*
+   * stage one indexes every token start with SIMD a window ahead of stage
+   * two, which builds the tree from that index, cut off at
+   * Options::max_depth; a little faster than ENGINE_ITERATIVE on many small
+   * tokens and a little slower on long strings, so not a general speed-up
+   */
+  ENGINE_STRUCTURAL,
+  /*
+   * the recursive descent without recursion: open arrays and objects are
+   * frames on the context stack, so deep input cannot overflow the thread
+   * stack and is cut off at Options::max_depth
+   */
+  ENGINE_ITERATIVE,
+};
+
+/*
+ * What a parse did, for finding out why one is slow. Only builds with
+ * TINYJSON_STATS defined fill it in; elsewhere Options::stats is ignored and
+ * the counting costs nothing. Each parse adds to it, so one Stats can sum up
+ * many; assign Stats() to start over. Times on several threads are summed.
+ */
+struct Stats {
+  /* input consumed up to the end of the value */
+  size_t bytes = 0;
+  /* values of each Type, object keys not included */
+  size_t nodes[Type::OBJECT + 1] = {};
+  /* arrays and objects open at once, at most */
+  size_t max_depth = 0;
+  /* bytes of Context::stack in use at most, and how often it grew */
+  size_t stack_peak = 0;
+  size_t stack_grows = 0;
+  /* heap and arena blocks taken, for the tree and for scratch space */
+  size_t allocations = 0;
+  /* nanoseconds in strings and keys, in numbers, and in everything else */
+  uint64_t string_ns = 0;
+  uint64_t number_ns = 0;
+  uint64_t structural_ns = 0;
+
+  void add(const Stats &other);
+};
+
+struct Options {
+  /* allocate the tree from this arena instead of the heap */
+  Arena *arena = nullptr;
+  /*
+   * strings and keys point into the input, which must outlive the tree;
+   * escaped ones are decoded on first access (or right away into the arena)
+   */
+  bool zero_copy = false;
+  Engine engine = ENGINE_ITERATIVE;
+  /*
+   * arrays and objects open at once; every engine but ENGINE_RECURSIVE
+   * keeps count, also on several threads, in a Batch and in a Projection
+   */
+  unsigned max_depth = 1024;
+  /*
+   * StreamParser only: the longest string or number it buffers while the
+   * rest of it has not arrived yet
+   */
+  size_t max_token = 16 << 20;
+  /*
+   * a large top-level array is split between its elements and parsed on
+   * this many threads; anything else is parsed on the calling thread
+   */
+  unsigned threads = 1;
+  /*
+   * keys too long to be stored inline in a Value are taken from this pool
+   * instead of copied; strings zero_copy borrows from the input are not
+   */
+  InternPool *intern = nullptr;
+  /* pool short string values as well as keys */
+  bool intern_values = false;
+  /* count what the parse does into this, see Stats */
+  Stats *stats = nullptr;
+  /*
+   * without an arena, take heap blocks from this before malloc; see
+   * Value::parse_into()
+   */
+  Recycler *recycler = nullptr;
+};
+
+/*
+ * Value is a 16-byte tagged cell. The first eight bytes hold the number or
+ * the pointer to string bytes, elements or members, followed by their length.
+ * Strings of up to SSO_CAPACITY bytes are stored inline over those twelve
+ * bytes instead.
+ */
 class Value {
 public:
-  Type type;
+  static constexpr size_t SSO_CAPACITY = 12;
 
-  /* string */
-  std::string s;
-  /* number */
-  double n;
-  /* array */
   union {
     struct {
-      Value **elems;
-      size_t array_len;
-    };
-    struct {
-      Member **members;
-      size_t members_len;
+      union {
+        /* number */
+        double n;
+        int64_t i;
+        uint64_t u;
+        /* string */
+        char *s;
+        /* array */
+        Value *elems;
+        /* object */
+        Member *members;
+      };
+      /* string length, array size or object size */
+      uint32_t len;
+      uint8_t ss_len;
+      uint8_t flags;
+      Type type;
+      Number subtype;
     };
+    /* inline string */
+    char ss[SSO_CAPACITY];
   };
 
   Value() {
-    this->type = Type::NIL;
     this->n = 0;
-    this->elems = nullptr;
-    this->array_len = 0;
+    this->len = 0;
+    this->ss_len = 0;
+    this->flags = 0;
+    this->type = Type::NIL;
+    this->subtype = Number::NUMBER_DOUBLE;
   }
 
-  ~Value() {
-    if (this->type == Type::ARRAY) {
-      for (int i = 0; i < this->array_len; i++) {
-        delete elems[i];
-      }
-      delete elems;
-      elems = nullptr;
-    } else if (this->type == Type::OBJECT) {
-      for (int i = 0; i < this->members_len; i++) {
-        delete members[i];
-      }
-      delete members;
-      members = nullptr;
+  ~Value() { this->release(); }
+
+  /*
+   * Moving hands the node over and leaves `from` a NIL. Values are never
+   * copied implicitly, since two of them would free the same children; use
+   * copy() for a deep copy.
+   */
+  Value(Value &&from) noexcept {
+    std::memcpy((void *)this, (const void *)&from, sizeof(Value));
+    from.flags = 0;
+    from.type = Type::NIL;
+  }
+  Value &operator=(Value &&from) noexcept {
+    if (this != &from) {
+      this->release();
+      std::memcpy((void *)this, (const void *)&from, sizeof(Value));
+      from.flags = 0;
+      from.type = Type::NIL;
     }
+    return *this;
   }
+  Value(const Value &) = delete;
+  Value &operator=(const Value &) = delete;
+
+  void release();
+  /* replaces this with a deep copy of `from`, which may share no storage */
+  void copy(Value &from, Arena *arena = nullptr);
+  void unescape();
 
   Parse parse(std::shared_ptr<const std::string> json);
+  Parse parse(std::shared_ptr<const std::string> json, Arena &arena);
+  Parse parse(std::shared_ptr<const std::string> json, const Options &options);
+  /* the buffer needs no terminator; zero-copy strings point into it */
+  Parse parse(const char *json, size_t len, const Options &options = Options());
+  Parse parse(std::string_view json, const Options &options = Options());
+  /*
+   * Parses over the tree this holds: its child arrays and strings go to
+   * `recycler` and the new tree is built from them, so parsing the same
+   * shape again allocates nothing. Blocks left over stay in the recycler.
+   * options.arena is ignored.
+   */
+  Parse parse_into(const char *json, size_t len, Recycler &recycler,
+                   const Options &options = Options());
+  Parse parse_into(std::string_view json, Recycler &recycler,
+                   const Options &options = Options());
+
+  bool is_equal(Value &rhs);
+
+  /* compact JSON text; numbers use the shortest form that reads back equal */
+  std::string stringify();
 
   void set_string(std::shared_ptr<const std::string> str);
   void set_cstring(const char *str, size_t len);
+  void set_cstring(const char *str, size_t len, Arena *arena);
   size_t get_string_len();
+  const char *get_string_data();
+  /* a copy; get_string_view() reads the string in place */
   std::string get_string();
+  std::string_view get_string_view();
 
   void set_boolean(bool b);
-  bool get_boolean();
+  bool get_boolean() const;
 
   void set_number(double n);
-  double get_number();
+  double get_number() const;
+  void set_int64(int64_t i);
+  int64_t get_int64() const;
+  void set_uint64(uint64_t u);
+  uint64_t get_uint64() const;
+  Number get_number_type() const;
 
-  size_t get_array_size();
+  size_t get_array_size() const;
   Value *get_array_elem(size_t index);
+  /* the elements in place, for range-based for */
+  std::span<Value> get_array_elems();
 
-  size_t get_object_size();
+  size_t get_object_size() const;
   Value *get_object_value(size_t index);
+  /* the members in place, for range-based for */
+  std::span<Member> get_object_members();
+  /* a copy; get_object_key_view() reads the key in place */
   std::string get_object_key(size_t index);
+  std::string_view get_object_key_view(size_t index);
   size_t get_object_key_len(size_t index);
+  /*
+   * The value of the first member named `key`, or nullptr. Large objects
+   * look it up in a hash index built while parsing, small ones scan.
+   */
+  Value *find_member(std::string_view key);
 
-  Type get_type();
+  /*
+   * Bytes the tree takes: this cell, the child arrays and object indexes, and
+   * the string bytes it owns. Borrowed and pooled strings are not counted.
+   */
+  size_t memory_usage() const;
+
+  Type get_type() const;
 };
 
+static_assert(sizeof(Value) == 16, "Value must fit in a 16-byte cell");
+
 class Member {
 public:
-  std::string key;
+  /* always a STRING */
+  Value key;
   Value value;
 
   Member() {}
-  Member(std::string k, Value v) : key(k), value(v) {}
+  Member(std::string_view k, Value &&v);
 
   std::string get_key();
+  std::string_view get_key_view();
   size_t get_key_len();
-  Value get_value();
+  Value &get_value();
+};
+
+/*
+ * MappedFile maps a file read-only, so parsing it makes no copy and starts
+ * before the whole file has been read from disk.
+ */
+class MappedFile {
+private:
+  char *data;
+  size_t size;
+  /* false when the platform has no mmap and the file was read instead */
+  bool mapped;
+
+public:
+  MappedFile() noexcept;
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool open(const char *path);
+  void close();
+
+  const char *get_data();
+  size_t get_size();
+};
+
+/*
+ * Document keeps the arena, the input and the root of one parse together, so
+ * the whole tree goes away in O(1) with the document and zero-copy strings
+ * never outlive the bytes they point into.
+ */
+class Document {
+public:
+  Arena arena;
+  std::shared_ptr<const std::string> json;
+  MappedFile file;
+  Value root;
+
+  /* options.arena is ignored, the document always uses its own */
+  Parse parse(std::shared_ptr<const std::string> json,
+              Options options = Options());
+  /* the buffer must outlive the document when options.zero_copy is set */
+  Parse parse(const char *json, size_t len, Options options = Options());
+  Parse parse_file(const char *path, Options options = Options());
+};
+
+/*
+ * Batch parses JSON Lines, one value per line with blank lines skipped. A
+ * newline scan finds the records, then `threads` workers take them in small
+ * runs, each with its own context and arena. Results are in input order and
+ * live as long as the batch.
+ */
+class Batch {
+private:
+  std::vector<std::unique_ptr<Arena>> arenas;
+  /* where each record's line ends */
+  std::vector<size_t> ends;
+
+  void parse_records(std::atomic<size_t> *next, Arena *arena,
+                     const Options &options, Stats *stats);
+
+public:
+  std::shared_ptr<const std::string> json;
+  /* where each record starts in the input */
+  std::vector<size_t> offsets;
+  std::vector<Value> values;
+  /* OK, or why the record with the same index is not a value */
+  std::vector<Parse> errors;
+
+  /*
+   * Returns the number of records that failed. No threads means one per
+   * hardware thread; options.arena is ignored, and ENGINE_STRUCTURAL parses
+   * like ENGINE_ITERATIVE.
+   * options.intern is shared between the threads.
+   */
+  size_t parse(std::shared_ptr<const std::string> json, unsigned threads = 0,
+               const Options &options = Options());
+  size_t get_size();
 };
 
 class Context {
 private:
   char *stack;
   size_t size, top;
+  /* token offsets found by the structural engine, a window at a time */
+  uint32_t *indexes;
+  size_t indexes_len, indexes_pos;
+  /* how far stage one has got, and what it carries into the next block */
+  size_t indexed;
+  uint64_t escape_carry, in_string_carry, scalar_carry;
 
   void stack_grow();
   void stack_grow_size(size_t len);
 
 public:
-  std::shared_ptr<const std::string> json;
+  /* the input; nothing at or past json_len is ever read */
+  const char *json;
+  size_t json_len;
   int64_t offset;
+  Arena *arena;
+  /* where heap blocks come from when there is no arena, if set */
+  Recycler *recycler;
+  bool zero_copy;
+  InternPool *intern;
+  bool intern_values;
+  /* other contexts intern into the same pool at the same time */
+  bool intern_shared;
+  /* parse_root() uses parse_iterative(), cut off at max_depth */
+  bool iterative;
+  /* every parser but parse_value() fails past this many open containers */
+  size_t max_depth;
+  /* counted into when built with TINYJSON_STATS, see Stats */
+  Stats *stats;
+  /* arrays and objects open around the value being parsed, for stats */
+  size_t depth;
 
   Context() noexcept;
   ~Context();
 
+  /* the byte at `i`, or the '\0' every JSON value stops at past the end */
+  inline char at(size_t i) const {
+    return i < this->json_len ? this->json[i] : '\0';
+  }
+
   inline void putc(char ch);
   inline char popc();
   void push(const char *str, size_t len);
   const char *pop(size_t len);
+  void pop_values(size_t count);
+  void pop_members(size_t count);
+
+  void *alloc(size_t size, size_t align = alignof(double));
+  /* the flags of a node whose storage came from alloc() */
+  inline uint8_t alloc_flags() const {
+    if (this->arena != nullptr)
+      return FLAG_ARENA;
+    return this->recycler != nullptr ? FLAG_POOLED : 0;
+  }
 
   void parse_whitespace();
   Parse parse_string_raw(char **str, size_t *strlen);
-  Parse parse_string(Value &v);
+  Parse parse_string(Value &v, bool is_key = false);
+  void set_string(Value &v, const char *str, size_t len, bool is_key);
   Parse parse_value(Value &v);
   Parse parse_true(Value &v);
   Parse parse_false(Value &v);
   Parse parse_null(Value &v);
   Parse parse_literal(Value &v);
   Parse parse_number(Value &v);
+  Parse parse_string_view(std::string_view *str);
   Parse parse_hex4(int64_t *offset, uint32_t *u);
   Parse parse_array(Value &v);
   Parse parse_object(Value &v);
+  Parse parse_iterative(Value &v);
+  /* sets the context up for `json` and parses it as Value::parse does */
+  Parse parse_document(Value &v, const char *json, size_t len,
+                       const Options &options);
+  /* a whole document, with the engine Value::parse was asked for */
+  Parse parse_root(Value &v);
   void encode_utf8(uint32_t u);
+
+  void start_index();
+  bool index_more();
+  /* a mark is left at indexes_pos, after indexing more if needed */
+  inline bool has_token() {
+    return this->indexes_pos < this->indexes_len || this->index_more();
+  }
+  bool at_next_token();
+  Parse parse_structural(Value &v);
+  Parse parse_indexed_value(Value &v);
+  Parse parse_indexed_string(Value &v, bool is_key);
+  Parse parse_indexed_array(Value &v);
+  Parse parse_indexed_object(Value &v);
+
+  /*
+   * Writes `v` as JSON onto the stack and returns it, valid until the next
+   * use of the context. Reusing one context reuses its buffer.
+   */
+  const char *stringify(Value &v, size_t *len);
+  void stringify_value(Value &v);
+  void stringify_string(const char *str, size_t len);
+  void stringify_number(Value &v);
+  const char *stringify(const BinaryValue &v, size_t *len);
+  void stringify_binary(const BinaryValue &v);
+  const char *stringify(const TapeValue &v, size_t *len);
+  void stringify_tape(const TapeValue &v);
+
+  Parse parse_parallel(Value &v, unsigned threads);
+  Parse parse_elements(size_t end, size_t *count);
+
+  template <typename Handler> Parse parse_sax_value(Handler &handler);
+  template <typename Handler> Parse parse_sax_array(Handler &handler);
+  template <typename Handler> Parse parse_sax_object(Handler &handler);
 };
 
+/*
+ * A Parser parses one document after another, e.g. one per request on a
+ * worker thread. It keeps the scratch stack, the structural index and the
+ * arena blocks it grew, so once they are large enough a parse allocates
+ * nothing. The tree lives in the parser's arena until the next parse() or
+ * reset(); zero-copy strings also need the input to live that long.
+ */
+class Parser {
+private:
+  Context c;
+  Arena arena;
+  Options options;
+
+public:
+  Value root;
+
+  /* options.arena is ignored, the parser always uses its own */
+  explicit Parser(const Options &options = Options());
+
+  Parse parse(const char *json, size_t len);
+  Parse parse(std::string_view json);
+  /* drops the tree and keeps the memory */
+  void reset();
+};
+
+/*
+ * SAX parsing reports the document to a handler as it is read instead of
+ * building a tree. A handler provides
+ *
+ *   void on_null();
+ *   void on_bool(bool b);
+ *   void on_number(Value &num);           a NUMBER, see get_number_type()
+ *   void on_string(std::string_view str);
+ *   void on_key(std::string_view key);
+ *   void on_start_array();
+ *   void on_end_array(size_t size);
+ *   void on_start_object();
+ *   void on_end_object(size_t size);
+ *
+ * Views are only valid during the call. Memory use does not grow with the
+ * document, only with its longest escaped string and its depth. Arrays and
+ * objects are parsed recursively, so more than `max_depth` of them open at
+ * once fail with NESTING_TOO_DEEP before the stack runs out. On error the
+ * handler has seen the events up to it.
+ */
+template <typename Handler>
+Parse parse_sax(std::string_view json, Handler &handler,
+                unsigned max_depth = Options().max_depth) {
+  Context c;
+  c.json = json.data();
+  c.json_len = json.size();
+  c.max_depth = max_depth;
+  c.parse_whitespace();
+  return c.parse_sax_value(handler);
+}
+
+template <typename Handler>
+Parse parse_sax(std::shared_ptr<const std::string> json, Handler &handler,
+                unsigned max_depth = Options().max_depth) {
+  return parse_sax(std::string_view(*json), handler, max_depth);
+}
+
+template <typename Handler> Parse Context::parse_sax_value(Handler &handler) {
+  Parse ret;
+  Value v;
+  std::string_view str;
+  switch (this->at(this->offset)) {
+  case 'n':
+    if ((ret = this->parse_null(v)) == Parse::OK)
+      handler.on_null();
+    return ret;
+  case 't':
+    if ((ret = this->parse_true(v)) == Parse::OK)
+      handler.on_bool(true);
+    return ret;
+  case 'f':
+    if ((ret = this->parse_false(v)) == Parse::OK)
+      handler.on_bool(false);
+    return ret;
+  case '\"':
+    if ((ret = this->parse_string_view(&str)) == Parse::OK)
+      handler.on_string(str);
+    return ret;
+  case '[':
+  case '{':
+    if (this->max_depth == 0)
+      return Parse::NESTING_TOO_DEEP;
+    this->max_depth--;
+    ret = this->at(this->offset) == '[' ? this->parse_sax_array(handler)
+                                        : this->parse_sax_object(handler);
+    this->max_depth++;
+    return ret;
+  case '\0':
+    return Parse::EXPECT_VALUE;
+  default:
+    if ((ret = this->parse_number(v)) == Parse::OK)
+      handler.on_number(v);
+    return ret;
+  }
+}
+
+template <typename Handler> Parse Context::parse_sax_array(Handler &handler) {
+  Parse ret;
+  size_t size = 0;
+  this->offset++;
+  handler.on_start_array();
+  this->parse_whitespace();
+  if (this->at(this->offset) == ']') {
+    this->offset++;
+    handler.on_end_array(0);
+    return Parse::OK;
+  }
+  while (1) {
+    if ((ret = this->parse_sax_value(handler)) != Parse::OK)
+      return ret;
+    size++;
+    this->parse_whitespace();
+    if (this->at(this->offset) == ',') {
+      this->offset++;
+      this->parse_whitespace();
+    } else if (this->at(this->offset) == ']') {
+      this->offset++;
+      handler.on_end_array(size);
+      return Parse::OK;
+    } else {
+      return Parse::MISS_COMMA_OR_SQUARE_BRACKET;
+    }
+  }
+}
+
+template <typename Handler> Parse Context::parse_sax_object(Handler &handler) {
+  Parse ret;
+  size_t size = 0;
+  std::string_view key;
+  this->offset++;
+  handler.on_start_object();
+  this->parse_whitespace();
+  if (this->at(this->offset) == '}') {
+    this->offset++;
+    handler.on_end_object(0);
+    return Parse::OK;
+  }
+  while (1) {
+    if (this->at(this->offset) != '\"')
+      return Parse::MISS_KEY;
+    if ((ret = this->parse_string_view(&key)) != Parse::OK)
+      return ret;
+    handler.on_key(key);
+    this->parse_whitespace();
+    if (this->at(this->offset) != ':')
+      return Parse::MISS_COLON;
+    this->offset++;
+    this->parse_whitespace();
+    if ((ret = this->parse_sax_value(handler)) != Parse::OK)
+      return ret;
+    size++;
+    this->parse_whitespace();
+    if (this->at(this->offset) == ',') {
+      this->offset++;
+      this->parse_whitespace();
+    } else if (this->at(this->offset) == '}') {
+      this->offset++;
+      handler.on_end_object(size);
+      return Parse::OK;
+    } else {
+      return Parse::MISS_COMMA_OR_CURLY_BRACKET;
+    }
+  }
+}
+
+/*
+ * Builder is the SAX handler that builds the same tree Value::parse does,
+ * from the heap or from `arena`. The tree is moved into `root` once it is
+ * complete.
+ */
+class Builder {
+private:
+  /* finished children waiting for their array or object to end */
+  Context values;
+  size_t count, depth;
+  Value &root;
+  Arena *arena;
+
+  void add(Value &v);
+
+public:
+  Builder(Value &root, Arena *arena = nullptr);
+  ~Builder();
+
+  /* drops a partly built tree, e.g. after an error */
+  void clear();
+
+  void on_null();
+  void on_bool(bool b);
+  void on_number(Value &num);
+  void on_string(std::string_view str);
+  void on_key(std::string_view key);
+  void on_start_array();
+  void on_end_array(size_t size);
+  void on_start_object();
+  void on_end_object(size_t size);
+};
+
+/* what StreamParser::feed() and finish() report */
+enum Feed {
+  /* everything was consumed and no value is complete yet */
+  FEED_MORE,
+  /* a top-level value is complete, take() it */
+  FEED_VALUE,
+  /* finish() only: the input ended cleanly after the last value */
+  FEED_END,
+  /* the input is not JSON, get_error() says why */
+  FEED_ERROR,
+};
+
+/*
+ * StreamParser builds values from input that arrives in chunks of any size,
+ * e.g. straight off a socket. A token split across chunks (a string, an
+ * escape, a number or a literal) is kept until it is complete, so only the
+ * current token is buffered, never the document. The input may hold several
+ * top-level values one after another, like JSON Lines. What a peer can make
+ * it hold besides the values is bounded by Options::max_depth and
+ * Options::max_token; of the other options only the arena is used.
+ *
+ *   while (receive(buf, &n))
+ *     while (n > 0 && (r = sp.feed(buf, n, &used)) != FEED_MORE) {
+ *       if (r == FEED_ERROR) ...
+ *       sp.take(v), buf += used, n -= used;
+ *     }
+ *   sp.finish();
+ */
+class StreamParser {
+private:
+  enum State : uint8_t {
+    S_VALUE,
+    /* right after '[' */
+    S_VALUE_OR_END,
+    S_ARRAY_NEXT,
+    /* right after '{' */
+    S_KEY_OR_END,
+    S_KEY,
+    S_COLON,
+    S_OBJECT_NEXT,
+    S_STRING,
+    S_STRING_ESCAPE,
+    S_NUMBER,
+    S_LITERAL,
+  };
+
+  /* an enclosing array or object while a nested one is open */
+  struct Frame {
+    bool object;
+    size_t size;
+  };
+
+  Value root;
+  Builder builder;
+  /* the pending token, parsed with `scratch` once it is complete */
+  std::string token;
+  Context scratch;
+  /* enclosing frames, the innermost one is kept in the fields below */
+  Context frames;
+  size_t max_depth, max_token;
+  size_t depth, size, values;
+  bool object, is_key, complete;
+  State state;
+  /* how far into a number or a literal we are */
+  uint8_t number_state;
+  const char *literal;
+  size_t literal_pos;
+  Parse error;
+
+  void load_token();
+  Feed fail(Parse error);
+  Parse start_value(char ch);
+  void open(bool object);
+  void close();
+  void value_done();
+  Parse end_string();
+  Parse end_number();
+
+public:
+  explicit StreamParser(const Options &options = Options());
+
+  /*
+   * Consumes `data` up to the end of the next top-level value. On FEED_VALUE
+   * `*used` tells how much of it was consumed; feed the rest again.
+   */
+  Feed feed(const char *data, size_t len, size_t *used);
+  /* the input is over: completes a trailing number or reports the error */
+  Feed finish();
+  /* moves the value completed by the last FEED_VALUE into `v` */
+  void take(Value &v);
+  Parse get_error();
+  /* forgets all state, to parse another stream */
+  void reset();
+};
+
+/*
+ * A Cursor reads a document on demand. Nothing is decoded until asked for,
+ * and the members and elements passed over on the way are skipped by
+ * matching brackets, without allocating. Skipped values are not validated,
+ * and neither is anything after the value looked up. The input must outlive
+ * the cursor.
+ *
+ *   Cursor doc(json);
+ *   int64_t id = doc["user"]["id"].get_int64();
+ *
+ * Looking up what is not there, or in something that is not an object or
+ * array, gives a cursor that is not found, whose getters return zero values.
+ */
+class Cursor {
+private:
+  const char *json;
+  size_t json_len;
+  /* where the value starts, json_len if there is none */
+  size_t pos;
+  Parse error;
+
+  Cursor(const Cursor &from, size_t pos, Parse error) noexcept;
+  void enter(Context &c, size_t offset);
+  Parse decode(Value &v);
+
+public:
+  Cursor() noexcept;
+  Cursor(const char *json, size_t len) noexcept;
+  explicit Cursor(std::string_view json) noexcept;
+
+  /* the value of the first member named `key` */
+  Cursor operator[](std::string_view key);
+  /* the element at `index` */
+  Cursor operator[](size_t index);
+
+  bool is_found();
+  /* OK, or what was malformed on the way to the value or in it */
+  Parse get_error();
+  Type get_type();
+  /* the JSON text of the value */
+  std::string_view get_raw();
+  /* decodes the value with everything under it */
+  Parse get_value(Value &v, const Options &options = Options());
+
+  /* these decode the value itself only, and assert its type */
+  bool get_boolean();
+  double get_number();
+  int64_t get_int64();
+  uint64_t get_uint64();
+  std::string get_string();
+};
+
+/*
+ * A Projection compiles a set of JSON Pointers (RFC 6901) into a trie once,
+ * then pulls all of them out of a document in a single pass. A `*` token
+ * stands for every element of an array or every member of an object. Only
+ * matched values are decoded; every branch no path goes down is skipped the
+ * way a Cursor skips it, without being validated.
+ *
+ * A projection reuses its buffers between documents, so give each thread
+ * its own.
+ */
+class Projection {
+private:
+  struct Node {
+    /* the pointer token leading here, unescaped */
+    std::string token;
+    bool wildcard;
+    /* the token as an array index, SIZE_MAX if it is none */
+    size_t index;
+    std::vector<size_t> children;
+    /* the paths that end here */
+    std::vector<size_t> paths;
+  };
+
+  std::vector<Node> nodes;
+  size_t size;
+  /* the nodes at the value being walked, then those under it, and so on */
+  std::vector<size_t> active;
+  /* the path of each value on the stack of `c` */
+  std::vector<size_t> matched;
+  std::vector<size_t> counts;
+  Context c;
+
+  Parse walk(size_t first, size_t last);
+  Parse match(size_t first, size_t last, std::string_view key, size_t index);
+
+public:
+  Projection();
+
+  /* compiles in a path; false, with nothing added, if it is malformed */
+  bool add(std::string_view pointer);
+  size_t get_size();
+
+  /*
+   * Sets `out` to an array holding, for each path in the order added, the
+   * array of values it matched in document order. options.engine and
+   * options.threads are ignored.
+   */
+  Parse extract(const char *json, size_t len, Value &out,
+                const Options &options = Options());
+  Parse extract(std::string_view json, Value &out,
+                const Options &options = Options());
+};
+
+/*
+ * A binary document is a Value tree laid out in one buffer with no pointers
+ * in it, so it can be kept in a file or shared memory and read in place,
+ * with nothing to parse or allocate. Each node is a 16-byte slot shaped
+ * like a Value, with byte offsets from the start of the buffer where a
+ * Value has pointers: an array points at its element slots, an object at
+ * its key and value slot pairs sorted by key, and a string longer than
+ * Value::SSO_CAPACITY at its bytes, with the length in the slot. Numbers
+ * and offsets are in the byte order of the host that encoded them, and
+ * open() refuses a buffer from a host of the other one. Slots make the
+ * encoding about twice the size of the text; it is made for reading, not
+ * for storing small.
+ *
+ * A BinaryValue reads one slot with the getters of Value. Since members
+ * are sorted, find_member() is a binary search and the members come out in
+ * key order; equal keys keep the order they had.
+ */
+class BinaryValue {
+private:
+  const char *data;
+  /* where the slot starts in `data` */
+  size_t pos;
+
+  friend class BinaryDocument;
+
+public:
+  BinaryValue() noexcept;
+  BinaryValue(const char *data, size_t pos) noexcept;
+
+  /* false for what find_member() did not find, whose type is NIL */
+  bool is_found() const;
+  Type get_type() const;
+
+  bool get_boolean() const;
+  double get_number() const;
+  int64_t get_int64() const;
+  uint64_t get_uint64() const;
+  Number get_number_type() const;
+
+  /* the bytes in place; short strings are kept in the slot itself */
+  size_t get_string_len() const;
+  const char *get_string_data() const;
+  std::string get_string() const;
+  std::string_view get_string_view() const;
+
+  size_t get_array_size() const;
+  BinaryValue get_array_elem(size_t index) const;
+
+  size_t get_object_size() const;
+  BinaryValue get_object_value(size_t index) const;
+  std::string get_object_key(size_t index) const;
+  std::string_view get_object_key_view(size_t index) const;
+  size_t get_object_key_len(size_t index) const;
+  /* the value of the first member named `key`, found by binary search */
+  BinaryValue find_member(std::string_view key) const;
+
+  /* decodes the value with everything under it into a tree */
+  void get_value(Value &v, Arena *arena = nullptr) const;
+  /* compact JSON text, with the members of objects in key order */
+  std::string stringify() const;
+};
+
+class BinaryDocument {
+private:
+  /* what encode() and parse() wrote */
+  std::string buffer;
+  MappedFile file;
+  const char *data;
+  size_t size;
+
+  Parse attach(const char *data, size_t size);
+
+public:
+  BinaryDocument() noexcept;
+  BinaryDocument(const BinaryDocument &) = delete;
+  BinaryDocument &operator=(const BinaryDocument &) = delete;
+
+  /* lays out `v` in the document's own buffer */
+  void encode(Value &v);
+  /* JSON text straight to a binary document; options.arena is ignored */
+  Parse parse(const char *json, size_t len, const Options &options = Options());
+  Parse parse(std::string_view json, const Options &options = Options());
+  /*
+   * Reads `size` bytes in place, which must outlive the document. Only the
+   * header is checked; validate() bytes that may not come from encode().
+   */
+  Parse open(const char *data, size_t size);
+  Parse open_file(const char *path);
+  /*
+   * Checks every slot, offset and length, that objects are sorted, and
+   * that no two nodes share bytes, so reading cannot go out of bounds.
+   */
+  Parse validate(unsigned max_depth = Options().max_depth);
+
+  /* the encoded bytes, to be written out as they are */
+  const char *get_data();
+  size_t get_size();
+  /* a NIL when the document is empty */
+  BinaryValue get_root();
+  std::string stringify();
+};
+
+/*
+ * A Tape holds a whole document as one array of 64-bit words in document
+ * order, with the bytes of every string and key in a single side buffer, so
+ * walking it reads memory front to back. A word is a tag in its top byte
+ * and a payload below it:
+ *
+ *   n t f    null, true and false
+ *   l u d    a number, whose int64, uint64 or double is the next word
+ *   "        a string or key: where its 32-bit length and bytes start
+ *   [ {      where the array or object ends, one past its close word, and
+ *            from bit 32 its size, which saturates at COUNT_MAX
+ *   ] }      where the matching open word is
+ *
+ * Since an open word says where it ends, a whole array or object is
+ * skipped in O(1). The tape is written by a SAX handler, so like
+ * parse_sax() it is parsed recursively and cut off at `max_depth`. A tape
+ * reuses its buffers from one parse to the next.
+ */
+class Tape {
+private:
+  std::vector<uint64_t> words;
+  std::string strings;
+  /* the open words of the arrays and objects being written */
+  std::vector<size_t> open;
+  Context c;
+
+  friend class TapeWriter;
+  friend class TapeValue;
+  friend class TapeIterator;
+
+public:
+  static constexpr size_t COUNT_MAX = (1 << 24) - 1;
+
+  Parse parse(const char *json, size_t len,
+              unsigned max_depth = Options().max_depth);
+  Parse parse(std::string_view json,
+              unsigned max_depth = Options().max_depth);
+
+  /* a NIL that is not found when nothing has been parsed */
+  TapeValue get_root() const;
+  /* the number of words */
+  size_t get_size() const;
+  std::string stringify() const;
+};
+
+/*
+ * The elements of an array or the members of an object, in order. Moving
+ * on jumps over the current value whatever is inside it.
+ *
+ *   for (TapeIterator it = v.begin(); it != v.end(); ++it)
+ *     if (it.key() == "id") ...
+ */
+class TapeIterator {
+private:
+  const Tape *tape;
+  /* the word of the element, or of the member's key */
+  size_t pos;
+  bool object;
+
+public:
+  TapeIterator(const Tape *tape, size_t pos, bool object) noexcept;
+
+  /* the element, or the value of the member */
+  inline TapeValue operator*() const;
+  /* the key of the member */
+  std::string_view key() const;
+  inline TapeIterator &operator++();
+  inline bool operator==(const TapeIterator &other) const {
+    return this->pos == other.pos;
+  }
+};
+
+/* One value on a tape, with the getters of Value. */
+class TapeValue {
+private:
+  const Tape *tape;
+  /* the word the value starts at */
+  size_t pos;
+
+  Value get_number_value() const;
+
+public:
+  TapeValue() noexcept;
+  TapeValue(const Tape *tape, size_t pos) noexcept;
+
+  /* false for what find_member() did not find, whose type is NIL */
+  bool is_found() const;
+  inline Type get_type() const {
+    if (this->tape == nullptr)
+      return Type::NIL;
+    switch ((char)(this->tape->words[this->pos] >> 56)) {
+    case 't':
+      return Type::TRUE;
+    case 'f':
+      return Type::FALSE;
+    case 'l':
+    case 'u':
+    case 'd':
+      return Type::NUMBER;
+    case '\"':
+      return Type::STRING;
+    case '[':
+      return Type::ARRAY;
+    case '{':
+      return Type::OBJECT;
+    default:
+      return Type::NIL;
+    }
+  }
+  /* the word right after this value and everything inside it */
+  inline size_t get_next() const {
+    uint64_t word = this->tape->words[this->pos];
+    switch ((char)(word >> 56)) {
+    case 'l':
+    case 'u':
+    case 'd':
+      return this->pos + 2;
+    case '[':
+    case '{':
+      return (uint32_t)word;
+    default:
+      return this->pos + 1;
+    }
+  }
+
+  bool get_boolean() const;
+  double get_number() const;
+  int64_t get_int64() const;
+  uint64_t get_uint64() const;
+  Number get_number_type() const;
+
+  size_t get_string_len() const;
+  const char *get_string_data() const;
+  std::string get_string() const;
+  std::string_view get_string_view() const;
+
+  /* counted on the tape only past Tape::COUNT_MAX */
+  size_t get_array_size() const;
+  size_t get_object_size() const;
+  /* these skip over what comes before, without reading into it */
+  TapeValue get_array_elem(size_t index) const;
+  TapeValue find_member(std::string_view key) const;
+  TapeIterator begin() const;
+  TapeIterator end() const;
+
+  /* decodes the value with everything under it into a tree */
+  void get_value(Value &v, Arena *arena = nullptr) const;
+  std::string stringify() const;
+};
+
+inline TapeValue TapeIterator::operator*() const {
+  return TapeValue(this->tape, this->object ? this->pos + 1 : this->pos);
+}
+
+inline TapeIterator &TapeIterator::operator++() {
+  this->pos = (**this).get_next();
+  return *this;
+}
+
 } // namespace tinyjson
 #endif /* _TINYJSON_H_ */
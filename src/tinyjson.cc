@@ -1,12 +1,85 @@
 #include "tinyjson.hh"
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <charconv>
 #include <cstdlib>
+#include <functional>
+#include <thread>
+
+#ifdef TINYJSON_STATS
+#include <chrono>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TINYJSON_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <cstdio>
+#endif
+
+#if !defined(TINYJSON_NO_SIMD) && defined(__AVX2__)
+#define TINYJSON_AVX2
+#include <immintrin.h>
+#elif !defined(TINYJSON_NO_SIMD) && defined(__SSE2__)
+#define TINYJSON_SSE2
+#include <emmintrin.h>
+#endif
+
+#if !defined(TINYJSON_NO_SIMD) && defined(__PCLMUL__)
+#define TINYJSON_PCLMUL
+#include <wmmintrin.h>
+#endif
 
 namespace tinyjson {
 #ifndef CONTEXT_STACK_INIT_SIZE
 #define CONTEXT_STACK_INIT_SIZE 256
 #endif
 
+#ifndef ARENA_BLOCK_INIT_SIZE
+#define ARENA_BLOCK_INIT_SIZE 4096
+#endif
+
+#ifndef ARENA_BLOCK_MAX_SIZE
+#define ARENA_BLOCK_MAX_SIZE (1 << 20)
+#endif
+
+/* smallest slice of a top-level array worth a thread of its own */
+#ifndef PARALLEL_MIN_CHUNK_SIZE
+#define PARALLEL_MIN_CHUNK_SIZE (16 << 10)
+#endif
+
+/*
+ * input the structural engine indexes ahead of stage two, so the strings
+ * stage two copies are still in cache
+ */
+#ifndef INDEX_WINDOW_SIZE
+#define INDEX_WINDOW_SIZE (16 << 10)
+#endif
+
+/* objects with at least this many members get a hash index */
+#ifndef MEMBER_HASH_MIN_SIZE
+#define MEMBER_HASH_MIN_SIZE 16
+#endif
+
+/* slots an InternPool starts with, a power of two */
+#ifndef INTERN_POOL_INIT_SIZE
+#define INTERN_POOL_INIT_SIZE 256
+#endif
+
+/* longest string value Options::intern_values pools */
+#ifndef INTERN_VALUE_MAX_SIZE
+#define INTERN_VALUE_MAX_SIZE 64
+#endif
+
+/* records a Batch worker takes at a time */
+#ifndef BATCH_GRAIN_SIZE
+#define BATCH_GRAIN_SIZE 64
+#endif
+
 #define EXPECT(c, idx, ch)                                                     \
   do {                                                                         \
     assert((c) == (ch));                                                       \
@@ -16,206 +89,3362 @@ namespace tinyjson {
 #define ISDIGIT(ch) ((ch) >= '0' && (ch) <= '9')
 #define ISDIGIT1TO9(ch) ((ch) >= '1' && (ch) <= '9')
 
+#ifdef TINYJSON_STATS
+/* Runs the statements with `stats` bound, if the context keeps any. */
+#define STATS(ctx, ...)                                                        \
+  do {                                                                         \
+    if ((ctx)->stats != nullptr) {                                             \
+      Stats *stats = (ctx)->stats;                                             \
+      __VA_ARGS__;                                                             \
+    }                                                                          \
+  } while (0)
+#define STATS_TIMER(ctx, clock) StatsTimer stats_timer((ctx)->stats, &Stats::clock)
+#define STATS_PARSE_TIMER(ctx) ParseTimer parse_timer((ctx)->stats)
+#define STATS_DEPTH(ctx) DepthGuard depth_guard(ctx)
+#else
+#define STATS(ctx, ...)                                                        \
+  do {                                                                         \
+  } while (0)
+#define STATS_TIMER(ctx, clock)
+#define STATS_PARSE_TIMER(ctx)
+#define STATS_DEPTH(ctx)
+#endif
+
 /************
- * Value Impl
+ * Helpers
  ************/
 
-Parse Value::parse(std::shared_ptr<const std::string> json) {
-  Context c;
-  c.json = json;
-  this->type = Type::NIL;
-  c.parse_whitespace();
-  return c.parse_value(*this);
+/* What a byte means where a value or whitespace may start. */
+enum CharClass : uint8_t {
+  CC_NUMBER, /* also anything invalid, which parse_number() rejects */
+  CC_NULL,
+  CC_TRUE,
+  CC_FALSE,
+  CC_STRING,
+  CC_ARRAY,
+  CC_OBJECT,
+  CC_END,
+  CC_SPACE,
 };
 
-Type Value::get_type() { return this->type; }
+static constexpr std::array<uint8_t, 256> make_char_classes() {
+  std::array<uint8_t, 256> t{};
+  t['n'] = CC_NULL;
+  t['t'] = CC_TRUE;
+  t['f'] = CC_FALSE;
+  t['\"'] = CC_STRING;
+  t['['] = CC_ARRAY;
+  t['{'] = CC_OBJECT;
+  t['\0'] = CC_END;
+  t[' '] = t['\t'] = t['\n'] = t['\r'] = CC_SPACE;
+  return t;
+}
 
-void Value::set_number(double n) {
-  this->type = Type::NUMBER;
-  this->n = n;
+static constexpr std::array<uint8_t, 256> char_classes = make_char_classes();
+
+/*
+ * How a byte is written inside a JSON string: 0 copies it as is, 'u' writes
+ * \u00XX, anything else is the letter after the backslash.
+ */
+static constexpr std::array<char, 256> make_escapes() {
+  std::array<char, 256> t{};
+  for (int ch = 0; ch < 0x20; ch++)
+    t[ch] = 'u';
+  t['\"'] = '\"';
+  t['\\'] = '\\';
+  t['\b'] = 'b';
+  t['\f'] = 'f';
+  t['\n'] = 'n';
+  t['\r'] = 'r';
+  t['\t'] = 't';
+  return t;
 }
 
-double Value::get_number() {
-  assert(this->type == Type::NUMBER);
-  return this->n;
+static constexpr std::array<char, 256> escapes = make_escapes();
+
+static inline bool is_space(char ch) {
+  return char_classes[(unsigned char)ch] == CC_SPACE;
 }
 
-void Value::set_boolean(bool b) {
-  if (b)
-    this->type = Type::TRUE;
-  else
-    this->type = Type::FALSE;
+/*
+ * Returns the first non-whitespace byte in [p, end), or `end`. Minified input
+ * almost never has whitespace, so that case is checked before anything else.
+ */
+static inline const char *skip_whitespace(const char *p, const char *end) {
+  if (p == end || !is_space(*p))
+    return p;
+#if defined(TINYJSON_AVX2) || defined(TINYJSON_SSE2)
+  const __m128i sp = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+  const __m128i lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    __m128i m = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(x, sp), _mm_cmpeq_epi8(x, tab)),
+        _mm_or_si128(_mm_cmpeq_epi8(x, lf), _mm_cmpeq_epi8(x, cr)));
+    uint32_t mask = ~_mm_movemask_epi8(m) & 0xFFFF;
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+  }
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  /*
+   * SWAR with an exact per-byte compare: the high bit of a byte in `ws` is
+   * set when that byte equals one of the four whitespace characters.
+   */
+  const uint64_t ones = 0x0101010101010101ULL, lows = 0x7F7F7F7F7F7F7F7FULL;
+  for (; end - p >= 8; p += 8) {
+    uint64_t x, ws = 0;
+    std::memcpy(&x, p, 8);
+    for (char c : {' ', '\t', '\n', '\r'}) {
+      uint64_t t = x ^ (ones * (unsigned char)c);
+      ws |= ~(((t & lows) + lows) | t);
+    }
+    uint64_t mask = ~ws & ~lows;
+    if (mask != 0)
+      return p + (__builtin_ctzll(mask) >> 3);
+  }
+#endif
+  while (p < end && is_space(*p))
+    p++;
+  return p;
 }
 
-bool Value::get_boolean() {
-  assert(this->type == Type::TRUE || this->type == Type::FALSE);
-  if (this->type == Type::TRUE)
-    return true;
-  else
-    return false;
+static bool hex4(const char *p, uint32_t *u) {
+  *u = 0;
+  for (int i = 0; i < 4; i++) {
+    *u <<= 4;
+    char ch = p[i];
+    if (ch >= '0' && ch <= '9')
+      *u |= ch - '0';
+    else if (ch >= 'A' && ch <= 'F')
+      *u |= ch - 'A' + 10;
+    else if (ch >= 'a' && ch <= 'f')
+      *u |= ch - 'a' + 10;
+    else
+      return false;
+  }
+  return true;
 }
 
-void Value::set_string(std::shared_ptr<const std::string> str) {
-  this->type = Type::STRING;
-  this->s = std::string(str->c_str());
+static size_t utf8_encode(char *out, uint32_t u) {
+  if (u <= 0x7F) {
+    out[0] = u & 0xFF;
+    return 1;
+  } else if (u <= 0x7FF) {
+    out[0] = 0xC0 | (u >> 6 & 0xFF);
+    out[1] = 0x80 | (u & 0x3F);
+    return 2;
+  } else if (u <= 0xFFFF) {
+    out[0] = 0xE0 | (u >> 12 & 0xFF);
+    out[1] = 0x80 | (u >> 6 & 0x3F);
+    out[2] = 0x80 | (u & 0x3F);
+    return 3;
+  } else {
+    assert(u <= 0x10FFFF);
+    out[0] = 0xF0 | (u >> 18 & 0xFF);
+    out[1] = 0x80 | (u >> 12 & 0x3F);
+    out[2] = 0x80 | (u >> 6 & 0x3F);
+    out[3] = 0x80 | (u & 0x3F);
+    return 4;
+  }
 }
 
-void Value::set_cstring(const char *str, size_t len) {
-  this->type = Type::STRING;
-  this->s = std::string(str, len);
+/*
+ * Returns the first byte in [p, end) that cannot be copied into a string as
+ * is: a quote, a backslash or a control character. Returns `end` if there is
+ * none.
+ */
+static inline const char *scan_string_chars(const char *p, const char *end) {
+#if defined(TINYJSON_AVX2)
+  const __m256i quote = _mm256_set1_epi8('\"');
+  const __m256i bslash = _mm256_set1_epi8('\\');
+  const __m256i ctrl = _mm256_set1_epi8(0x1F);
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)p);
+    __m256i m = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(x, quote),
+                        _mm256_cmpeq_epi8(x, bslash)),
+        _mm256_cmpeq_epi8(_mm256_min_epu8(x, ctrl), x));
+    uint32_t mask = _mm256_movemask_epi8(m);
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+  }
+#endif
+#if defined(TINYJSON_AVX2) || defined(TINYJSON_SSE2)
+  const __m128i quote16 = _mm_set1_epi8('\"');
+  const __m128i bslash16 = _mm_set1_epi8('\\');
+  const __m128i ctrl16 = _mm_set1_epi8(0x1F);
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    __m128i m = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(x, quote16), _mm_cmpeq_epi8(x, bslash16)),
+        _mm_cmpeq_epi8(_mm_min_epu8(x, ctrl16), x));
+    uint32_t mask = _mm_movemask_epi8(m);
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+  }
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  /*
+   * SWAR: a byte's high bit is set in `mask` when it matches. Borrows can
+   * only produce false matches above a real one, so the lowest bit is exact.
+   */
+  const uint64_t ones = 0x0101010101010101ULL, highs = 0x8080808080808080ULL;
+  for (; end - p >= 8; p += 8) {
+    uint64_t x;
+    std::memcpy(&x, p, 8);
+    uint64_t q = x ^ (ones * '\"'), b = x ^ (ones * '\\');
+    uint64_t mask = ((q - ones) & ~q) | ((b - ones) & ~b) |
+                    ((x - ones * 0x20) & ~x);
+    mask &= highs;
+    if (mask != 0)
+      return p + (__builtin_ctzll(mask) >> 3);
+  }
+#endif
+  for (; p < end; p++) {
+    if (*p == '\"' || *p == '\\' || (unsigned char)*p < 0x20)
+      return p;
+  }
+  return end;
 }
 
-size_t Value::get_string_len() {
-  assert(this->get_type() == Type::STRING);
-  return this->s.length();
+/*
+ * Sets a bit in each mask for every byte of the 64-byte block that is a
+ * backslash, a quote or a control character, all that matters inside a
+ * string.
+ */
+static inline void classify_string_block(const char *p, uint64_t *bslash,
+                                         uint64_t *quote, uint64_t *ctrl) {
+#if defined(TINYJSON_AVX2)
+  auto bits = [](__m256i m) {
+    return (uint64_t)(uint32_t)_mm256_movemask_epi8(m);
+  };
+  *bslash = *quote = *ctrl = 0;
+  for (int i = 0; i < 64; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(p + i));
+    *bslash |= bits(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\'))) << i;
+    *quote |= bits(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\"'))) << i;
+    *ctrl |= bits(_mm256_cmpeq_epi8(
+                 _mm256_min_epu8(x, _mm256_set1_epi8(0x1F)), x))
+             << i;
+  }
+#elif defined(TINYJSON_SSE2)
+  auto bits = [](__m128i m) {
+    return (uint64_t)(uint32_t)_mm_movemask_epi8(m);
+  };
+  *bslash = *quote = *ctrl = 0;
+  for (int i = 0; i < 64; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(p + i));
+    *bslash |= bits(_mm_cmpeq_epi8(x, _mm_set1_epi8('\\'))) << i;
+    *quote |= bits(_mm_cmpeq_epi8(x, _mm_set1_epi8('\"'))) << i;
+    *ctrl |= bits(_mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(0x1F)), x))
+             << i;
+  }
+#else
+  *bslash = *quote = *ctrl = 0;
+  for (int i = 0; i < 64; i++) {
+    uint64_t bit = 1ULL << i;
+    if (p[i] == '\\')
+      *bslash |= bit;
+    else if (p[i] == '\"')
+      *quote |= bit;
+    else if ((unsigned char)p[i] < 0x20)
+      *ctrl |= bit;
+  }
+#endif
 }
 
-std::string Value::get_string() {
-  assert(this->get_type() == Type::STRING);
-  return this->s;
+/*
+ * Sets a bit in each mask for every byte of the 64-byte block that is
+ * whitespace or one of the operators {}[]:, .
+ */
+static inline void classify_block(const char *p, uint64_t *space,
+                                  uint64_t *op) {
+#if defined(TINYJSON_AVX2)
+  /*
+   * Each class is looked up by the low nibble of the byte and compared with
+   * the byte itself. OR-ing in 0x20 folds '[' and ']' onto '{' and '}'.
+   */
+  const __m256i space_table = _mm256_setr_epi8(
+      ' ', 100, 100, 100, 17, 100, 113, 2, 100, '\t', '\n', 112, 100, '\r',
+      100, 100, ' ', 100, 100, 100, 17, 100, 113, 2, 100, '\t', '\n', 112, 100,
+      '\r', 100, 100);
+  const __m256i op_table = _mm256_setr_epi8(
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, ':', '{', ',', '}', 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, ':', '{', ',', '}', 0, 0);
+  auto bits = [](__m256i m) {
+    return (uint64_t)(uint32_t)_mm256_movemask_epi8(m);
+  };
+  *space = *op = 0;
+  for (int i = 0; i < 64; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(p + i));
+    *space |= bits(_mm256_cmpeq_epi8(x, _mm256_shuffle_epi8(space_table, x)))
+              << i;
+    *op |= bits(_mm256_cmpeq_epi8(_mm256_or_si256(x, _mm256_set1_epi8(0x20)),
+                                  _mm256_shuffle_epi8(op_table, x)))
+           << i;
+  }
+#elif defined(TINYJSON_SSE2)
+  auto eq = [](__m128i x, char c) {
+    return (uint64_t)(uint32_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(x, _mm_set1_epi8(c)));
+  };
+  *space = *op = 0;
+  for (int i = 0; i < 64; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(p + i));
+    *space |= (eq(x, ' ') | eq(x, '\t') | eq(x, '\n') | eq(x, '\r')) << i;
+    *op |= (eq(x, '{') | eq(x, '}') | eq(x, '[') | eq(x, ']') | eq(x, ':') |
+            eq(x, ','))
+           << i;
+  }
+#else
+  *space = *op = 0;
+  for (int i = 0; i < 64; i++) {
+    uint64_t bit = 1ULL << i;
+    switch (p[i]) {
+    case ' ':
+    case '\t':
+    case '\n':
+    case '\r':
+      *space |= bit;
+      break;
+    case '{':
+    case '}':
+    case '[':
+    case ']':
+    case ':':
+    case ',':
+      *op |= bit;
+      break;
+    }
+  }
+#endif
 }
 
-size_t Value::get_array_size() {
-  assert(Type::ARRAY == this->type);
-  return this->array_len;
+/*
+ * Returns the bytes escaped by a backslash. `carry` is set when the block
+ * ends in a backslash that escapes the first byte of the next one.
+ * Backslashes are rare, so walking them one by one is cheap.
+ */
+static inline uint64_t find_escaped(uint64_t bslash, uint64_t *carry) {
+  uint64_t escaped = *carry;
+  bslash &= ~escaped;
+  *carry = 0;
+  while (bslash != 0) {
+    uint64_t first = bslash & (0 - bslash), next = first << 1;
+    if (next == 0)
+      *carry = 1;
+    escaped |= next;
+    bslash &= ~(first | next);
+  }
+  return escaped;
 }
 
-Value *Value::get_array_elem(size_t index) {
-  assert(Type::ARRAY == this->type);
-  assert(this->elems != nullptr);
-  assert(index < this->array_len);
-  return this->elems[index];
+/* Bit i of the result is the XOR of bits 0..i, i.e. "inside a string". */
+static inline uint64_t prefix_xor(uint64_t x) {
+#if defined(TINYJSON_PCLMUL)
+  __m128i all_ones = _mm_set1_epi8((char)0xFF);
+  __m128i r = _mm_clmulepi64_si128(_mm_set_epi64x(0, (int64_t)x), all_ones, 0);
+  return (uint64_t)_mm_cvtsi128_si64(r);
+#else
+  x ^= x << 1;
+  x ^= x << 2;
+  x ^= x << 4;
+  x ^= x << 8;
+  x ^= x << 16;
+  x ^= x << 32;
+  return x;
+#endif
 }
 
-size_t Value::get_object_size() {
-  assert(Type::OBJECT == this->type);
-  assert(this->members != nullptr);
-  return this->members_len;
+/*
+ * Decodes a string body the parser has already validated, so escapes are not
+ * checked again. Every escape is longer than what it decodes to, so `out`
+ * needs at most `len` bytes.
+ */
+static size_t decode_escaped(const char *raw, size_t len, char *out) {
+  const char *end = raw + len;
+  char *o = out;
+  while (raw < end) {
+    const char *bs = (const char *)std::memchr(raw, '\\', end - raw);
+    size_t run = (bs != nullptr ? bs : end) - raw;
+    std::memcpy(o, raw, run);
+    o += run;
+    raw += run;
+    if (raw == end)
+      break;
+    raw++;
+    switch (*raw++) {
+    case 'b':
+      *o++ = '\b';
+      break;
+    case 'f':
+      *o++ = '\f';
+      break;
+    case 'n':
+      *o++ = '\n';
+      break;
+    case 'r':
+      *o++ = '\r';
+      break;
+    case 't':
+      *o++ = '\t';
+      break;
+    case 'u':
+      uint32_t u, u2;
+      hex4(raw, &u);
+      raw += 4;
+      if (u >= 0xD800 && u <= 0xDBFF) {
+        hex4(raw + 2, &u2);
+        raw += 6;
+        u = (((u - 0xD800) << 10) | (u2 - 0xDC00)) + 0x10000;
+      }
+      o += utf8_encode(o, u);
+      break;
+    default: /* '"', '\\' and '/' stand for themselves */
+      *o++ = raw[-1];
+    }
+  }
+  return o - out;
 }
 
-Value *Value::get_object_value(size_t index) {
-  assert(Type::OBJECT == this->type);
-  assert(this->members != nullptr);
-  assert(index < this->members_len);
-  return &this->members[index]->value;
+/*
+ * Finds the bracket that closes the array opening at `start`, and after each
+ * of `parts - 1` evenly spaced targets the first comma between two of its
+ * elements. Brackets and commas inside strings are masked out the same way
+ * index_more() does it. Returns `len` if the array does not close.
+ */
+static size_t split_array(const char *cstr, size_t len, size_t start,
+                          size_t parts, size_t *splits, size_t *nsplits) {
+  uint64_t escape_carry = 0, in_string_carry = 0;
+  size_t depth = 0, step = (len - start) / parts, target = start + step;
+  *nsplits = 0;
+  for (size_t pos = start; pos < len; pos += 64) {
+    const char *p = cstr + pos;
+    char block[64];
+    if (len - pos < 64) {
+      std::memset(block, ' ', 64);
+      std::memcpy(block, p, len - pos);
+      p = block;
+    }
+
+    uint64_t bslash, quote, ctrl, space, op;
+    classify_string_block(p, &bslash, &quote, &ctrl);
+    classify_block(p, &space, &op);
+    quote &= ~find_escaped(bslash, &escape_carry);
+    uint64_t in_string = prefix_xor(quote) ^ in_string_carry;
+    in_string_carry = (uint64_t)((int64_t)in_string >> 63);
+
+    for (uint64_t ops = op & ~in_string; ops != 0; ops &= ops - 1) {
+      size_t i = pos + __builtin_ctzll(ops);
+      switch (cstr[i]) {
+      case '[':
+      case '{':
+        depth++;
+        break;
+      case ']':
+      case '}':
+        if (--depth == 0)
+          return i;
+        break;
+      case ',':
+        if (depth == 1 && i >= target && *nsplits < parts - 1) {
+          splits[(*nsplits)++] = i;
+          target = i + step;
+        }
+        break;
+      }
+    }
+  }
+  return len;
 }
 
-std::string Value::get_object_key(size_t index) {
-  assert(Type::OBJECT == this->type);
-  assert(this->members != nullptr);
-  assert(index < this->members_len);
-  return this->members[index]->key;
+/* A multiply-mix over eight bytes at a time; keys are short. */
+static inline uint32_t hash_key(const char *key, size_t len) {
+  const uint64_t m = 0x9E3779B97F4A7C15ULL;
+  uint64_t h = len * m;
+  for (; len >= 8; key += 8, len -= 8) {
+    uint64_t w;
+    std::memcpy(&w, key, 8);
+    h = (h ^ w) * m;
+    h ^= h >> 29;
+  }
+  if (len > 0) {
+    uint64_t w = 0;
+    std::memcpy(&w, key, len);
+    h = (h ^ w) * m;
+    h ^= h >> 29;
+  }
+  return (uint32_t)(h ^ (h >> 32));
 }
 
-size_t Value::get_object_key_len(size_t index) {
-  assert(Type::OBJECT == this->type);
-  assert(this->members != nullptr);
-  assert(index < this->members_len);
-  return this->members[index]->key.length();
+#ifdef TINYJSON_STATS
+static inline uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+/* Adds the time until the end of the scope to one of the Stats clocks. */
+class StatsTimer {
+private:
+  uint64_t *ns;
+  std::chrono::steady_clock::time_point start;
+
+public:
+  StatsTimer(Stats *stats, uint64_t Stats::*clock) {
+    this->ns = stats != nullptr ? &(stats->*clock) : nullptr;
+    if (this->ns != nullptr)
+      this->start = std::chrono::steady_clock::now();
+  }
+  ~StatsTimer() {
+    if (this->ns != nullptr)
+      *this->ns += elapsed_ns(this->start);
+  }
+};
+
+/* Structural time is a whole parse less the strings and numbers in it. */
+class ParseTimer {
+private:
+  Stats *stats;
+  uint64_t inner;
+  std::chrono::steady_clock::time_point start;
+
+public:
+  ParseTimer(Stats *stats) {
+    this->stats = stats;
+    if (stats != nullptr) {
+      this->inner = stats->string_ns + stats->number_ns;
+      this->start = std::chrono::steady_clock::now();
+    }
+  }
+  ~ParseTimer() {
+    if (this->stats == nullptr)
+      return;
+    uint64_t inner = this->stats->string_ns + this->stats->number_ns;
+    uint64_t total = elapsed_ns(this->start);
+    if (total > inner - this->inner)
+      this->stats->structural_ns += total - (inner - this->inner);
+  }
+};
+
+/* Keeps Context::depth and Stats::max_depth up to date in one scope. */
+class DepthGuard {
+private:
+  Context *c;
+
+public:
+  DepthGuard(Context *c) {
+    this->c = c;
+    if (c->stats != nullptr) {
+      c->depth++;
+      c->stats->max_depth = std::max(c->stats->max_depth, c->depth);
+    }
+  }
+  ~DepthGuard() {
+    if (this->c->stats != nullptr)
+      this->c->depth--;
+  }
+};
+#endif
+
+/* slots in the open-addressing table of an object with `n` members */
+static inline size_t member_slots(size_t n) {
+  return (size_t)1 << (64 - __builtin_clzll(2 * n - 1));
+}
+
+/*
+ * Large objects keep a hash index right after their members, in the same
+ * block: the hash of every key, then a table of member index + 1 (0 being
+ * empty). Returns the bytes it needs after `n` members.
+ */
+static inline size_t member_index_size(size_t n) {
+  if (n < MEMBER_HASH_MIN_SIZE)
+    return 0;
+  return (n + member_slots(n)) * sizeof(uint32_t);
+}
+
+/* Fills in the index allocated after the members, see member_index_size(). */
+static void index_members(Value &v) {
+  if (v.len < MEMBER_HASH_MIN_SIZE)
+    return;
+  uint32_t *hashes = (uint32_t *)(v.members + v.len);
+  uint32_t *slots = hashes + v.len;
+  size_t mask = member_slots(v.len) - 1;
+  std::string decoded;
+  std::memset(slots, 0, (mask + 1) * sizeof(uint32_t));
+  for (size_t i = 0; i < v.len; i++) {
+    Value &k = v.members[i].key;
+    std::string_view key;
+    if (k.flags & FLAG_ESCAPED) {
+      /* hashed as it will decode, the key itself stays lazy */
+      decoded.resize(k.len);
+      key = {decoded.data(), decode_escaped(k.s, k.len, decoded.data())};
+    } else {
+      key = k.get_string_view();
+    }
+    uint32_t h = hash_key(key.data(), key.size());
+    hashes[i] = h;
+    size_t slot = h & mask;
+    while (slots[slot] != 0)
+      slot = (slot + 1) & mask;
+    slots[slot] = i + 1;
+  }
+  v.flags |= FLAG_HASHED;
 }
 
 /************
- * Member Impl
+ * Arena Impl
  ************/
 
-std::string Member::get_key() { return this->key; }
+Arena::Arena() noexcept {
+  this->head = nullptr;
+  this->cur = this->end = nullptr;
+  this->block_size = ARENA_BLOCK_INIT_SIZE;
+}
+
+Arena::~Arena() { this->clear(); }
+
+void *Arena::alloc_slow(size_t size, size_t align) {
+  size_t need = sizeof(Block) + size + align;
+  size_t bsize = this->block_size;
+  while (bsize < need)
+    bsize <<= 1;
+  if (this->block_size < ARENA_BLOCK_MAX_SIZE)
+    this->block_size <<= 1; /* size = size * 2 */
+
+  Block *b = (Block *)std::malloc(bsize);
+  b->next = this->head;
+  b->size = bsize;
+  this->head = b;
+  this->cur = (char *)(b + 1);
+  this->end = (char *)b + bsize;
+  return this->alloc(size, align);
+}
+
+void Arena::clear() {
+  Block *b = this->head;
+  while (b != nullptr) {
+    Block *next = b->next;
+    std::free(b);
+    b = next;
+  }
+  this->head = nullptr;
+  this->cur = this->end = nullptr;
+  this->block_size = ARENA_BLOCK_INIT_SIZE;
+}
+
+void Arena::reset() {
+  if (this->head == nullptr)
+    return;
+  if (this->head->next != nullptr) {
+    /* one block as large as all of them holds the next fill by itself */
+    size_t capacity = 0;
+    for (Block *b = this->head; b != nullptr; b = b->next)
+      capacity += b->size;
+    this->clear();
+    Block *b = (Block *)std::malloc(capacity);
+    b->next = nullptr;
+    b->size = capacity;
+    this->head = b;
+    while (this->block_size < ARENA_BLOCK_MAX_SIZE &&
+           this->block_size < capacity)
+      this->block_size <<= 1;
+  }
+  this->cur = (char *)(this->head + 1);
+  this->end = (char *)this->head + this->head->size;
+}
+
+void Arena::adopt(Arena &other) {
+  if (other.head == nullptr)
+    return;
+  /* append, so that the block this arena is bumping through stays first */
+  Block **tail = &this->head;
+  while (*tail != nullptr)
+    tail = &(*tail)->next;
+  *tail = other.head;
+  other.head = nullptr;
+  other.cur = other.end = nullptr;
+  other.block_size = ARENA_BLOCK_INIT_SIZE;
+}
 
-size_t Member::get_key_len() { return this->key.length(); }
+size_t Arena::get_block_count() {
+  size_t count = 0;
+  for (Block *b = this->head; b != nullptr; b = b->next)
+    count++;
+  return count;
+}
 
-Value Member::get_value() { return this->value; }
+size_t Arena::get_capacity() {
+  size_t capacity = 0;
+  for (Block *b = this->head; b != nullptr; b = b->next)
+    capacity += b->size;
+  return capacity;
+}
 
 /************
- * Content Impl
+ * InternPool Impl
  ************/
 
-void Context::stack_grow() {
-  if (this->size != 0)
-    this->size += this->size >> 1; /* size = size * 1.5 */
-  else
-    this->size = CONTEXT_STACK_INIT_SIZE;
-  this->stack = (char *)std::realloc(this->stack, this->size);
+InternPool::InternPool() noexcept {
+  this->slots = nullptr;
+  this->count = this->capacity = 0;
 }
 
-void Context::stack_grow_size(size_t len) {
-  while (this->top + len > this->size)
-    this->stack_grow();
-}
+InternPool::~InternPool() { std::free(this->slots); }
 
-Context::Context() noexcept {
-  this->offset = 0;
-  this->json = nullptr;
-  this->stack = nullptr;
-  this->top = this->size = 0;
+void InternPool::grow() {
+  size_t capacity = this->capacity != 0 ? this->capacity << 1
+                                        : INTERN_POOL_INIT_SIZE;
+  Slot *slots = (Slot *)std::calloc(capacity, sizeof(Slot));
+  for (size_t i = 0; i < this->capacity; i++) {
+    Slot &old = this->slots[i];
+    if (old.str == nullptr)
+      continue;
+    size_t slot = old.hash & (capacity - 1);
+    while (slots[slot].str != nullptr)
+      slot = (slot + 1) & (capacity - 1);
+    slots[slot] = old;
+  }
+  std::free(this->slots);
+  this->slots = slots;
+  this->capacity = capacity;
 }
 
-Context::~Context() {
-  if (this->stack != nullptr) {
-    free(this->stack);
-    this->stack = nullptr;
+std::string_view InternPool::intern(std::string_view str) {
+  assert(str.size() <= UINT32_MAX);
+  if (2 * (this->count + 1) > this->capacity)
+    this->grow();
+  uint32_t hash = hash_key(str.data(), str.size());
+  size_t mask = this->capacity - 1, slot = hash & mask;
+  for (; this->slots[slot].str != nullptr; slot = (slot + 1) & mask) {
+    Slot &s = this->slots[slot];
+    if (s.hash == hash && s.len == str.size() &&
+        std::memcmp(s.str, str.data(), str.size()) == 0)
+      return std::string_view(s.str, s.len);
   }
-  this->top = this->size = 0;
+  /* one byte at least, so that no pooled string is ever nullptr */
+  char *copy = (char *)this->strings.alloc(str.size() + 1, 1);
+  std::memcpy(copy, str.data(), str.size());
+  this->slots[slot] = {copy, (uint32_t)str.size(), hash};
+  this->count++;
+  return std::string_view(copy, str.size());
 }
 
-inline void Context::putc(char ch) {
-  if (this->top == this->size)
-    this->stack_grow();
-  this->stack[top++] = ch;
+std::string_view InternPool::intern_shared(std::string_view str) {
+  std::lock_guard<std::mutex> guard(this->lock);
+  return this->intern(str);
 }
 
-inline char Context::popc() {
-  assert(this->stack != nullptr);
-  char ch = this->stack[top--];
-  this->size -= 1;
-  return ch;
+void InternPool::clear() {
+  std::free(this->slots);
+  this->slots = nullptr;
+  this->count = this->capacity = 0;
+  this->strings.clear();
 }
 
-void Context::push(const char *str, size_t len) {
-  this->stack_grow_size(len);
-  std::memcpy(this->stack + this->top, str, len);
+size_t InternPool::get_size() { return this->count; }
+
+/************
+ * Recycler Impl
+ ************/
+
+/* the size class `size` rounds up to; class k holds (4 + k % 4) << (k / 4 + 2) */
+static inline size_t size_class(size_t size) {
+  if (size <= 16)
+    return 0;
+  size_t x = size - 1;
+  int b = 63 - __builtin_clzll(x);
+  return (b - 4) * 4 + (x >> (b - 2)) - 3;
 }
 
-const char *Context::pop(size_t len) {
-  assert(this->stack != nullptr);
-  assert(this->top - len >= 0);
-  this->top -= len;
-  return this->stack + this->top;
+static inline size_t class_size(size_t k) {
+  return (size_t)(4 + k % 4) << (k / 4 + 2);
 }
 
-void Context::parse_whitespace() {
-  size_t i = this->offset;
-  while ((*this->json)[i] == ' ' || (*this->json)[i] == '\t' ||
-         (*this->json)[i] == '\n' || (*this->json)[i] == '\r')
-    i++;
-  this->offset = i;
+/* the bytes a heap block of `v` was allocated with */
+static size_t block_capacity(const Value &v) {
+  size_t size;
+  if (v.type == Type::STRING)
+    size = v.len;
+  else if (v.type == Type::ARRAY)
+    size = v.len * sizeof(Value);
+  else
+    size = v.len * sizeof(Member) + member_index_size(v.len);
+  return v.flags & FLAG_POOLED ? class_size(size_class(size)) : size;
 }
 
-Parse Context::parse_null(Value &v) {
-  size_t i = this->offset;
-  EXPECT((*this->json)[i], &i, 'n');
-  if ((*this->json)[i++] != 'u' || (*this->json)[i++] != 'l' ||
-      (*this->json)[i++] != 'l')
-    return Parse::INVALID_VALUE;
-  this->offset = i;
-  v.type = Type::NIL;
-  return Parse::OK;
+Recycler::Recycler() noexcept {
+  std::fill(std::begin(this->lists), std::end(this->lists), nullptr);
+  this->count = this->capacity = this->mallocs = 0;
 }
 
-Parse Context::parse_string_raw(char **str, size_t *strlen) {
-  size_t head = this->top, len;
-  int64_t i = this->offset;
-  EXPECT((*this->json)[i], &i, '\"');
+Recycler::~Recycler() { this->clear(); }
+
+void Recycler::put(void *block, size_t capacity) {
+  if (capacity < 16) {
+    std::free(block);
+    return;
+  }
+  /* the largest class that fits, as blocks from malloc may fall between */
+  size_t k = size_class(capacity);
+  if (class_size(k) > capacity)
+    k--;
+  if (k >= CLASSES) {
+    std::free(block);
+    return;
+  }
+  *(void **)block = this->lists[k];
+  this->lists[k] = block;
+  this->count++;
+  this->capacity += class_size(k);
+}
+
+void *Recycler::alloc(size_t size) {
+  size_t k = size_class(size);
+  if (k < CLASSES && this->lists[k] != nullptr) {
+    void *block = this->lists[k];
+    this->lists[k] = *(void **)block;
+    this->count--;
+    this->capacity -= class_size(k);
+    return block;
+  }
+  this->mallocs++;
+  return std::malloc(class_size(k));
+}
+
+void Recycler::take(Value &v) {
+  if (!(v.flags & (FLAG_ARENA | FLAG_INLINE | FLAG_BORROWED))) {
+    if (v.type == Type::ARRAY) {
+      for (size_t i = 0; i < v.len; i++)
+        this->take(v.elems[i]);
+    } else if (v.type == Type::OBJECT) {
+      for (size_t i = 0; i < v.len; i++) {
+        this->take(v.members[i].key);
+        this->take(v.members[i].value);
+      }
+    }
+    if ((v.type == Type::STRING || v.type == Type::ARRAY ||
+         v.type == Type::OBJECT) &&
+        v.s != nullptr)
+      this->put(v.s, block_capacity(v));
+  }
+  v.type = Type::NIL;
+  v.flags = 0;
+  v.elems = nullptr;
+  v.len = 0;
+}
+
+void Recycler::clear() {
+  for (void *&list : this->lists) {
+    while (list != nullptr) {
+      void *next = *(void **)list;
+      std::free(list);
+      list = next;
+    }
+  }
+  this->count = this->capacity = 0;
+}
+
+size_t Recycler::get_block_count() { return this->count; }
+
+size_t Recycler::get_capacity() { return this->capacity; }
+
+size_t Recycler::get_malloc_count() { return this->mallocs; }
+
+/************
+ * Stats Impl
+ ************/
+
+void Stats::add(const Stats &other) {
+  this->bytes += other.bytes;
+  for (size_t t = 0; t <= Type::OBJECT; t++)
+    this->nodes[t] += other.nodes[t];
+  this->max_depth = std::max(this->max_depth, other.max_depth);
+  this->stack_peak = std::max(this->stack_peak, other.stack_peak);
+  this->stack_grows += other.stack_grows;
+  this->allocations += other.allocations;
+  this->string_ns += other.string_ns;
+  this->number_ns += other.number_ns;
+  this->structural_ns += other.structural_ns;
+}
+
+/************
+ * Value Impl
+ ************/
+
+static inline void *copy_alloc(Arena *arena, size_t size, size_t align) {
+  if (arena != nullptr)
+    return arena->alloc(size, align);
+  return std::malloc(size);
+}
+
+Parse Value::parse(std::shared_ptr<const std::string> json) {
+  return this->parse(json, Options());
+};
+
+Parse Value::parse(std::shared_ptr<const std::string> json, Arena &arena) {
+  Options options;
+  options.arena = &arena;
+  return this->parse(json, options);
+}
+
+Parse Value::parse(std::shared_ptr<const std::string> json,
+                   const Options &options) {
+  return this->parse(json->data(), json->size(), options);
+}
+
+Parse Value::parse(std::string_view json, const Options &options) {
+  return this->parse(json.data(), json.size(), options);
+}
+
+Parse Value::parse(const char *json, size_t len, const Options &options) {
+  Context c;
+  this->release();
+  return c.parse_document(*this, json, len, options);
+}
+
+Parse Value::parse_into(const char *json, size_t len, Recycler &recycler,
+                        const Options &options) {
+  if (recycler.c == nullptr)
+    recycler.c = std::make_unique<Context>();
+  Options o = options;
+  o.arena = nullptr;
+  o.recycler = &recycler;
+  recycler.take(*this);
+  return recycler.c->parse_document(*this, json, len, o);
+}
+
+Parse Value::parse_into(std::string_view json, Recycler &recycler,
+                        const Options &options) {
+  return this->parse_into(json.data(), json.size(), recycler, options);
+}
+
+void Value::release() {
+  if (!(this->flags & (FLAG_ARENA | FLAG_INLINE | FLAG_BORROWED))) {
+    if (this->type == Type::STRING) {
+      std::free(this->s);
+    } else if (this->type == Type::ARRAY) {
+      for (size_t i = 0; i < this->len; i++)
+        this->elems[i].release();
+      std::free(this->elems);
+    } else if (this->type == Type::OBJECT) {
+      for (size_t i = 0; i < this->len; i++) {
+        this->members[i].key.release();
+        this->members[i].value.release();
+      }
+      std::free(this->members);
+    }
+  }
+  this->type = Type::NIL;
+  this->flags = 0;
+  this->elems = nullptr;
+  this->len = 0;
+}
+
+void Value::copy(Value &from, Arena *arena) {
+  assert(this != &from);
+  this->release();
+  switch (from.type) {
+  case Type::STRING:
+    this->set_cstring(from.get_string_data(), from.get_string_len(), arena);
+    return;
+  case Type::ARRAY:
+    this->elems = from.len == 0 ? nullptr
+                                : (Value *)copy_alloc(arena,
+                                                      from.len * sizeof(Value),
+                                                      alignof(Value));
+    for (size_t i = 0; i < from.len; i++)
+      new (&this->elems[i]) Value();
+    break;
+  case Type::OBJECT:
+    this->members =
+        from.len == 0
+            ? nullptr
+            : (Member *)copy_alloc(arena,
+                                   from.len * sizeof(Member) +
+                                       member_index_size(from.len),
+                                   alignof(Member));
+    for (size_t i = 0; i < from.len; i++)
+      new (&this->members[i]) Member();
+    break;
+  default:
+    this->n = from.n;
+    this->subtype = from.subtype;
+    this->type = from.type;
+    return;
+  }
+  this->type = from.type;
+  this->flags = arena != nullptr ? FLAG_ARENA : 0;
+  this->len = from.len;
+  if (this->type == Type::ARRAY) {
+    for (size_t i = 0; i < this->len; i++)
+      this->elems[i].copy(from.elems[i], arena);
+  } else {
+    for (size_t i = 0; i < this->len; i++) {
+      this->members[i].key.copy(from.members[i].key, arena);
+      this->members[i].value.copy(from.members[i].value, arena);
+    }
+    index_members(*this);
+  }
+}
+
+void Value::unescape() {
+  assert(this->type == Type::STRING && (this->flags & FLAG_ESCAPED));
+  char *buf = (char *)std::malloc(this->len);
+  size_t len = decode_escaped(this->s, this->len, buf);
+  if (len <= SSO_CAPACITY) {
+    std::memcpy(this->ss, buf, len);
+    std::free(buf);
+    this->ss_len = len;
+    this->flags = FLAG_INLINE;
+  } else {
+    this->s = buf;
+    this->len = len;
+    this->flags = 0;
+  }
+}
+
+bool Value::is_equal(Value &rhs) {
+  if (this->type != rhs.type)
+    return false;
+  switch (this->type) {
+  case Type::NUMBER:
+    if (this->subtype != rhs.subtype)
+      return this->get_number() == rhs.get_number();
+    if (this->subtype == Number::NUMBER_DOUBLE)
+      return this->n == rhs.n;
+    return this->u == rhs.u;
+  case Type::STRING:
+    /* pooled strings are shared, so equal ones are mostly one pointer */
+    if (!((this->flags | rhs.flags) & (FLAG_INLINE | FLAG_ESCAPED)) &&
+        this->s == rhs.s && this->len == rhs.len)
+      return true;
+    return this->get_string_view() == rhs.get_string_view();
+  case Type::ARRAY:
+    if (this->len != rhs.len)
+      return false;
+    for (size_t i = 0; i < this->len; i++)
+      if (!this->elems[i].is_equal(rhs.elems[i]))
+        return false;
+    return true;
+  case Type::OBJECT:
+    /* members are compared in order, which is what both parsers produce */
+    if (this->len != rhs.len)
+      return false;
+    for (size_t i = 0; i < this->len; i++)
+      if (!this->members[i].key.is_equal(rhs.members[i].key) ||
+          !this->members[i].value.is_equal(rhs.members[i].value))
+        return false;
+    return true;
+  default:
+    return true;
+  }
+}
+
+std::string Value::stringify() {
+  Context c;
+  size_t len;
+  const char *json = c.stringify(*this, &len);
+  return std::string(json, len);
+}
+
+Type Value::get_type() const { return this->type; }
+
+void Value::set_number(double n) {
+  this->release();
+  this->type = Type::NUMBER;
+  this->subtype = Number::NUMBER_DOUBLE;
+  this->n = n;
+}
+
+double Value::get_number() const {
+  assert(this->type == Type::NUMBER);
+  switch (this->subtype) {
+  case Number::NUMBER_INT64:
+    return (double)this->i;
+  case Number::NUMBER_UINT64:
+    return (double)this->u;
+  default:
+    return this->n;
+  }
+}
+
+void Value::set_int64(int64_t i) {
+  this->release();
+  this->type = Type::NUMBER;
+  this->subtype = Number::NUMBER_INT64;
+  this->i = i;
+}
+
+int64_t Value::get_int64() const {
+  assert(this->type == Type::NUMBER);
+  switch (this->subtype) {
+  case Number::NUMBER_INT64:
+    return this->i;
+  case Number::NUMBER_UINT64:
+    assert(this->u <= (uint64_t)INT64_MAX);
+    return (int64_t)this->u;
+  default:
+    /* also false for NaN */
+    assert(this->n >= -9223372036854775808.0 &&
+           this->n < 9223372036854775808.0);
+    return (int64_t)this->n;
+  }
+}
+
+void Value::set_uint64(uint64_t u) {
+  this->release();
+  this->type = Type::NUMBER;
+  this->subtype = Number::NUMBER_UINT64;
+  this->u = u;
+}
+
+uint64_t Value::get_uint64() const {
+  assert(this->type == Type::NUMBER);
+  switch (this->subtype) {
+  case Number::NUMBER_INT64:
+    assert(this->i >= 0);
+    return (uint64_t)this->i;
+  case Number::NUMBER_UINT64:
+    return this->u;
+  default:
+    assert(this->n > -1.0 && this->n < 18446744073709551616.0);
+    return (uint64_t)this->n;
+  }
+}
+
+Number Value::get_number_type() const {
+  assert(this->type == Type::NUMBER);
+  return this->subtype;
+}
+
+void Value::set_boolean(bool b) {
+  this->release();
+  if (b)
+    this->type = Type::TRUE;
+  else
+    this->type = Type::FALSE;
+}
+
+bool Value::get_boolean() const {
+  assert(this->type == Type::TRUE || this->type == Type::FALSE);
+  if (this->type == Type::TRUE)
+    return true;
+  else
+    return false;
+}
+
+void Value::set_string(std::shared_ptr<const std::string> str) {
+  this->set_cstring(str->c_str(), str->length());
+}
+
+void Value::set_cstring(const char *str, size_t len) {
+  this->set_cstring(str, len, nullptr);
+}
+
+void Value::set_cstring(const char *str, size_t len, Arena *arena) {
+  assert(len <= UINT32_MAX);
+  this->release();
+  this->type = Type::STRING;
+  if (len <= SSO_CAPACITY) {
+    if (len != 0)
+      std::memcpy(this->ss, str, len);
+    this->ss_len = len;
+    this->flags = FLAG_INLINE;
+    return;
+  }
+  if (arena != nullptr) {
+    this->s = (char *)arena->alloc(len, 1);
+    this->flags = FLAG_ARENA;
+  } else {
+    this->s = (char *)std::malloc(len);
+  }
+  std::memcpy(this->s, str, len);
+  this->len = len;
+}
+
+size_t Value::get_string_len() {
+  assert(this->get_type() == Type::STRING);
+  if (this->flags & FLAG_ESCAPED)
+    this->unescape();
+  return this->flags & FLAG_INLINE ? this->ss_len : this->len;
+}
+
+const char *Value::get_string_data() {
+  assert(this->get_type() == Type::STRING);
+  if (this->flags & FLAG_ESCAPED)
+    this->unescape();
+  return this->flags & FLAG_INLINE ? this->ss : this->s;
+}
+
+std::string Value::get_string() {
+  return std::string(this->get_string_data(), this->get_string_len());
+}
+
+std::string_view Value::get_string_view() {
+  return std::string_view(this->get_string_data(), this->get_string_len());
+}
+
+size_t Value::get_array_size() const {
+  assert(Type::ARRAY == this->type);
+  return this->len;
+}
+
+Value *Value::get_array_elem(size_t index) {
+  assert(Type::ARRAY == this->type);
+  assert(this->elems != nullptr);
+  assert(index < this->len);
+  return &this->elems[index];
+}
+
+std::span<Value> Value::get_array_elems() {
+  assert(Type::ARRAY == this->type);
+  return std::span<Value>(this->elems, this->len);
+}
+
+size_t Value::get_object_size() const {
+  assert(Type::OBJECT == this->type);
+  return this->len;
+}
+
+Value *Value::get_object_value(size_t index) {
+  assert(Type::OBJECT == this->type);
+  assert(this->members != nullptr);
+  assert(index < this->len);
+  return &this->members[index].value;
+}
+
+std::span<Member> Value::get_object_members() {
+  assert(Type::OBJECT == this->type);
+  return std::span<Member>(this->members, this->len);
+}
+
+std::string Value::get_object_key(size_t index) {
+  assert(Type::OBJECT == this->type);
+  assert(this->members != nullptr);
+  assert(index < this->len);
+  return this->members[index].key.get_string();
+}
+
+std::string_view Value::get_object_key_view(size_t index) {
+  assert(Type::OBJECT == this->type);
+  assert(this->members != nullptr);
+  assert(index < this->len);
+  return this->members[index].key.get_string_view();
+}
+
+/* keys from an InternPool usually match by pointer alone */
+static inline bool key_equals(Value &k, std::string_view key) {
+  if (!(k.flags & (FLAG_INLINE | FLAG_ESCAPED)) && k.s == key.data())
+    return k.len == key.size();
+  return k.get_string_view() == key;
+}
+
+Value *Value::find_member(std::string_view key) {
+  assert(Type::OBJECT == this->type);
+  if (this->flags & FLAG_HASHED) {
+    const uint32_t *hashes = (const uint32_t *)(this->members + this->len);
+    const uint32_t *slots = hashes + this->len;
+    size_t mask = member_slots(this->len) - 1;
+    uint32_t h = hash_key(key.data(), key.size());
+    for (size_t slot = h & mask; slots[slot] != 0; slot = (slot + 1) & mask) {
+      Member &m = this->members[slots[slot] - 1];
+      if (hashes[slots[slot] - 1] == h && key_equals(m.key, key))
+        return &m.value;
+    }
+    return nullptr;
+  }
+  for (size_t i = 0; i < this->len; i++) {
+    if (key_equals(this->members[i].key, key))
+      return &this->members[i].value;
+  }
+  return nullptr;
+}
+
+/* the bytes under `v`, not counting its own cell */
+static size_t owned_bytes(const Value &v) {
+  size_t bytes = 0;
+  switch (v.type) {
+  case Type::STRING:
+    if (!(v.flags & (FLAG_INLINE | FLAG_BORROWED)))
+      bytes = v.len;
+    break;
+  case Type::ARRAY:
+    bytes = v.len * sizeof(Value);
+    for (size_t i = 0; i < v.len; i++)
+      bytes += owned_bytes(v.elems[i]);
+    break;
+  case Type::OBJECT:
+    bytes = v.len * sizeof(Member) + member_index_size(v.len);
+    for (size_t i = 0; i < v.len; i++)
+      bytes += owned_bytes(v.members[i].key) + owned_bytes(v.members[i].value);
+    break;
+  default:
+    break;
+  }
+  return bytes;
+}
+
+size_t Value::memory_usage() const { return sizeof(Value) + owned_bytes(*this); }
+
+size_t Value::get_object_key_len(size_t index) {
+  assert(Type::OBJECT == this->type);
+  assert(this->members != nullptr);
+  assert(index < this->len);
+  return this->members[index].key.get_string_len();
+}
+
+/************
+ * Member Impl
+ ************/
+
+Member::Member(std::string_view k, Value &&v) : value(std::move(v)) {
+  this->key.set_cstring(k.data(), k.size());
+}
+
+std::string Member::get_key() { return this->key.get_string(); }
+
+std::string_view Member::get_key_view() { return this->key.get_string_view(); }
+
+size_t Member::get_key_len() { return this->key.get_string_len(); }
+
+Value &Member::get_value() { return this->value; }
+
+/************
+ * Builder Impl
+ ************/
+
+Builder::Builder(Value &root, Arena *arena) : root(root) {
+  this->count = this->depth = 0;
+  this->arena = arena;
+  this->values.arena = arena;
+}
+
+Builder::~Builder() { this->values.pop_values(this->count); }
+
+void Builder::clear() {
+  this->values.pop_values(this->count);
+  this->count = this->depth = 0;
+}
+
+void Builder::add(Value &v) {
+  if (this->depth == 0) {
+    this->root.release();
+    std::memcpy((void *)&this->root, (const void *)&v, sizeof(Value));
+  } else {
+    this->values.push((const char *)&v, sizeof(Value));
+    this->count++;
+  }
+  /* moved out, so `v` must not release it */
+  v.type = Type::NIL;
+}
+
+void Builder::on_null() {
+  Value v;
+  this->add(v);
+}
+
+void Builder::on_bool(bool b) {
+  Value v;
+  v.type = b ? Type::TRUE : Type::FALSE;
+  this->add(v);
+}
+
+void Builder::on_number(Value &num) {
+  Value v;
+  std::memcpy((void *)&v, (const void *)&num, sizeof(Value));
+  this->add(v);
+}
+
+void Builder::on_string(std::string_view str) {
+  Value v;
+  v.set_cstring(str.data(), str.size(), this->arena);
+  this->add(v);
+}
+
+/* a key followed by its value has the layout of a Member on the stack */
+void Builder::on_key(std::string_view key) { this->on_string(key); }
+
+void Builder::on_start_array() { this->depth++; }
+
+void Builder::on_end_array(size_t size) {
+  Value v;
+  v.type = Type::ARRAY;
+  v.flags = this->arena != nullptr ? FLAG_ARENA : 0;
+  v.len = size;
+  if (size != 0) {
+    this->count -= size;
+    size *= sizeof(Value);
+    v.elems = (Value *)this->values.alloc(size, alignof(Value));
+    std::memcpy((void *)v.elems, this->values.pop(size), size);
+  }
+  this->depth--;
+  this->add(v);
+}
+
+void Builder::on_start_object() { this->depth++; }
+
+void Builder::on_end_object(size_t size) {
+  Value v;
+  v.type = Type::OBJECT;
+  v.flags = this->arena != nullptr ? FLAG_ARENA : 0;
+  v.len = size;
+  if (size != 0) {
+    this->count -= 2 * size;
+    size *= sizeof(Member);
+    v.members = (Member *)this->values.alloc(
+        size + member_index_size(v.len), alignof(Member));
+    std::memcpy((void *)v.members, this->values.pop(size), size);
+    index_members(v);
+  }
+  this->depth--;
+  this->add(v);
+}
+
+/************
+ * StreamParser Impl
+ ************/
+
+/* Where a number token is in the grammar, see number_continues(). */
+enum NumberState : uint8_t {
+  N_SIGN,
+  N_ZERO,
+  N_INT,
+  N_DOT,
+  N_FRAC,
+  N_E,
+  N_E_SIGN,
+  N_EXP,
+};
+
+/*
+ * Advances `*ns` over `ch` and returns true, or returns false if `ch` cannot
+ * continue the number, which is where parse_number() would stop as well.
+ */
+static inline bool number_continues(uint8_t *ns, char ch) {
+  switch (*ns) {
+  case N_SIGN:
+    if (ch == '0')
+      *ns = N_ZERO;
+    else if (ISDIGIT1TO9(ch))
+      *ns = N_INT;
+    else
+      return false;
+    return true;
+  case N_ZERO:
+  case N_INT:
+  case N_FRAC:
+    if (ISDIGIT(ch) && *ns != N_ZERO)
+      return true;
+    if (ch == '.' && *ns != N_FRAC)
+      *ns = N_DOT;
+    else if (ch == 'e' || ch == 'E')
+      *ns = N_E;
+    else
+      return false;
+    return true;
+  case N_DOT:
+    if (!ISDIGIT(ch))
+      return false;
+    *ns = N_FRAC;
+    return true;
+  case N_E:
+    if (ch == '+' || ch == '-') {
+      *ns = N_E_SIGN;
+      return true;
+    }
+    [[fallthrough]];
+  case N_E_SIGN:
+  case N_EXP:
+    if (!ISDIGIT(ch))
+      return false;
+    *ns = N_EXP;
+    return true;
+  default:
+    return false;
+  }
+}
+
+StreamParser::StreamParser(const Options &options)
+    : builder(root, options.arena) {
+  this->max_depth = options.max_depth;
+  this->max_token = options.max_token;
+  this->depth = 0;
+  this->reset();
+}
+
+void StreamParser::reset() {
+  this->builder.clear();
+  this->root.release();
+  this->frames.pop(this->depth > 1 ? (this->depth - 1) * sizeof(Frame) : 0);
+  this->token.clear();
+  this->depth = this->size = this->values = 0;
+  this->object = this->is_key = this->complete = false;
+  this->state = S_VALUE;
+  this->number_state = N_SIGN;
+  this->literal = nullptr;
+  this->literal_pos = 0;
+  this->error = Parse::OK;
+}
+
+Parse StreamParser::get_error() { return this->error; }
+
+void StreamParser::take(Value &v) {
+  v.release();
+  std::memcpy((void *)&v, (const void *)&this->root, sizeof(Value));
+  this->root.type = Type::NIL;
+}
+
+/* points the scratch context at the token, which may have moved */
+void StreamParser::load_token() {
+  this->scratch.json = this->token.data();
+  this->scratch.json_len = this->token.size();
+  this->scratch.offset = 0;
+}
+
+Feed StreamParser::fail(Parse error) {
+  this->error = error;
+  this->builder.clear();
+  return FEED_ERROR;
+}
+
+void StreamParser::open(bool object) {
+  if (this->depth > 0) {
+    Frame f = {this->object, this->size};
+    this->frames.push((const char *)&f, sizeof(Frame));
+  }
+  this->depth++;
+  this->object = object;
+  this->size = 0;
+  if (object) {
+    this->builder.on_start_object();
+    this->state = S_KEY_OR_END;
+  } else {
+    this->builder.on_start_array();
+    this->state = S_VALUE_OR_END;
+  }
+}
+
+void StreamParser::close() {
+  if (this->object)
+    this->builder.on_end_object(this->size);
+  else
+    this->builder.on_end_array(this->size);
+  if (--this->depth > 0) {
+    Frame f;
+    std::memcpy(&f, this->frames.pop(sizeof(Frame)), sizeof(Frame));
+    this->object = f.object;
+    this->size = f.size;
+  }
+  this->value_done();
+}
+
+void StreamParser::value_done() {
+  if (this->depth == 0) {
+    this->complete = true;
+    this->values++;
+    this->state = S_VALUE;
+  } else {
+    this->size++;
+    this->state = this->object ? S_OBJECT_NEXT : S_ARRAY_NEXT;
+  }
+}
+
+Parse StreamParser::start_value(char ch) {
+  switch (ch) {
+  case '\"':
+    this->token.assign(1, ch);
+    this->is_key = false;
+    this->state = S_STRING;
+    return Parse::OK;
+  case '[':
+  case '{':
+    if (this->depth >= this->max_depth)
+      return Parse::NESTING_TOO_DEEP;
+    this->open(ch == '{');
+    return Parse::OK;
+  case 'n':
+    this->literal = "null";
+    break;
+  case 't':
+    this->literal = "true";
+    break;
+  case 'f':
+    this->literal = "false";
+    break;
+  case '\0':
+    return Parse::EXPECT_VALUE;
+  default:
+    if (ch != '-' && !ISDIGIT(ch))
+      return Parse::INVALID_VALUE;
+    this->token.assign(1, ch);
+    this->number_state = ch == '-' ? N_SIGN : ch == '0' ? N_ZERO : N_INT;
+    this->state = S_NUMBER;
+    return Parse::OK;
+  }
+  this->literal_pos = 1;
+  this->state = S_LITERAL;
+  return Parse::OK;
+}
+
+/* The token holds the whole string with its quotes; the context checks it. */
+Parse StreamParser::end_string() {
+  std::string_view str;
+  this->load_token();
+  Parse ret = this->scratch.parse_string_view(&str);
+  if (ret != Parse::OK)
+    return ret;
+  if (this->is_key) {
+    this->builder.on_key(str);
+    this->state = S_COLON;
+  } else {
+    this->builder.on_string(str);
+    this->value_done();
+  }
+  return Parse::OK;
+}
+
+Parse StreamParser::end_number() {
+  Value v;
+  this->load_token();
+  Parse ret = this->scratch.parse_number(v);
+  if (ret != Parse::OK)
+    return ret;
+  this->builder.on_number(v);
+  this->value_done();
+  return Parse::OK;
+}
+
+Feed StreamParser::feed(const char *data, size_t len, size_t *used) {
+  const char *p = data, *end = data + len;
+  Parse ret;
+  *used = 0;
+  if (this->error != Parse::OK)
+    return FEED_ERROR;
+
+  while (p < end) {
+    switch (this->state) {
+    case S_STRING: {
+      const char *q = scan_string_chars(p, end);
+      /* with room for the quote or backslash that ends the run */
+      if (this->token.size() + (q - p) + (q < end) > this->max_token)
+        return this->fail(Parse::DOCUMENT_TOO_LARGE);
+      this->token.append(p, q - p);
+      if ((p = q) == end)
+        break;
+      char ch = *p++;
+      this->token.push_back(ch);
+      if (ch == '\\') {
+        this->state = S_STRING_ESCAPE;
+      } else if ((ret = this->end_string()) != Parse::OK) {
+        /* a control character, or the string had an error before it */
+        return this->fail(ret);
+      }
+      break;
+    }
+    case S_STRING_ESCAPE:
+      if (this->token.size() == this->max_token)
+        return this->fail(Parse::DOCUMENT_TOO_LARGE);
+      this->token.push_back(*p++);
+      this->state = S_STRING;
+      break;
+    case S_NUMBER: {
+      const char *q = p;
+      while (q < end && number_continues(&this->number_state, *q))
+        q++;
+      if (this->token.size() + (q - p) > this->max_token)
+        return this->fail(Parse::DOCUMENT_TOO_LARGE);
+      this->token.append(p, q - p);
+      if ((p = q) == end)
+        break;
+      if ((ret = this->end_number()) != Parse::OK)
+        return this->fail(ret);
+      break;
+    }
+    case S_LITERAL:
+      if (*p++ != this->literal[this->literal_pos++])
+        return this->fail(Parse::INVALID_VALUE);
+      if (this->literal[this->literal_pos] == '\0') {
+        if (this->literal[0] == 'n')
+          this->builder.on_null();
+        else
+          this->builder.on_bool(this->literal[0] == 't');
+        this->value_done();
+      }
+      break;
+    default: {
+      if ((p = skip_whitespace(p, end)) == end)
+        break;
+      char ch = *p++;
+      switch (this->state) {
+      case S_VALUE_OR_END:
+        if (ch == ']') {
+          this->close();
+          break;
+        }
+        [[fallthrough]];
+      case S_VALUE:
+        if ((ret = this->start_value(ch)) != Parse::OK)
+          return this->fail(ret);
+        break;
+      case S_ARRAY_NEXT:
+        if (ch == ',' && this->size == UINT32_MAX)
+          return this->fail(Parse::DOCUMENT_TOO_LARGE);
+        if (ch == ',')
+          this->state = S_VALUE;
+        else if (ch == ']')
+          this->close();
+        else
+          return this->fail(Parse::MISS_COMMA_OR_SQUARE_BRACKET);
+        break;
+      case S_KEY_OR_END:
+        if (ch == '}') {
+          this->close();
+          break;
+        }
+        [[fallthrough]];
+      case S_KEY:
+        if (ch != '\"')
+          return this->fail(Parse::MISS_KEY);
+        this->token.assign(1, ch);
+        this->is_key = true;
+        this->state = S_STRING;
+        break;
+      case S_COLON:
+        if (ch != ':')
+          return this->fail(Parse::MISS_COLON);
+        this->state = S_VALUE;
+        break;
+      case S_OBJECT_NEXT:
+        if (ch == ',' && this->size == UINT32_MAX)
+          return this->fail(Parse::DOCUMENT_TOO_LARGE);
+        if (ch == ',')
+          this->state = S_KEY;
+        else if (ch == '}')
+          this->close();
+        else
+          return this->fail(Parse::MISS_COMMA_OR_CURLY_BRACKET);
+        break;
+      default:
+        break;
+      }
+    }
+    }
+    if (this->complete) {
+      this->complete = false;
+      *used = p - data;
+      return FEED_VALUE;
+    }
+  }
+  *used = len;
+  return FEED_MORE;
+}
+
+Feed StreamParser::finish() {
+  Parse ret;
+  std::string_view str;
+  if (this->error != Parse::OK)
+    return FEED_ERROR;
+  switch (this->state) {
+  case S_STRING:
+  case S_STRING_ESCAPE:
+    /* the context reports the same error the parser would at the end */
+    this->load_token();
+    return this->fail(this->scratch.parse_string_view(&str));
+  case S_NUMBER:
+    if ((ret = this->end_number()) != Parse::OK)
+      return this->fail(ret);
+    if (this->complete) {
+      this->complete = false;
+      return FEED_VALUE;
+    }
+    return this->finish();
+  case S_LITERAL:
+    return this->fail(Parse::INVALID_VALUE);
+  case S_VALUE:
+    if (this->depth == 0 && this->values > 0)
+      return FEED_END;
+    [[fallthrough]];
+  case S_VALUE_OR_END:
+    return this->fail(Parse::EXPECT_VALUE);
+  case S_ARRAY_NEXT:
+    return this->fail(Parse::MISS_COMMA_OR_SQUARE_BRACKET);
+  case S_KEY_OR_END:
+  case S_KEY:
+    return this->fail(Parse::MISS_KEY);
+  case S_COLON:
+    return this->fail(Parse::MISS_COLON);
+  case S_OBJECT_NEXT:
+    return this->fail(Parse::MISS_COMMA_OR_CURLY_BRACKET);
+  }
+  return FEED_ERROR;
+}
+
+/************
+ * MappedFile Impl
+ ************/
+
+MappedFile::MappedFile() noexcept {
+  this->data = nullptr;
+  this->size = 0;
+  this->mapped = false;
+}
+
+MappedFile::~MappedFile() { this->close(); }
+
+bool MappedFile::open(const char *path) {
+  this->close();
+#if defined(TINYJSON_MMAP)
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    return false;
+  }
+  this->size = st.st_size;
+  if (this->size != 0) {
+    /*
+     * The parser never reads at or past the end of its input, so the file
+     * is mapped as it is, without a terminator or padding after it.
+     */
+    void *p = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      ::close(fd);
+      this->size = 0;
+      return false;
+    }
+    madvise(p, this->size, MADV_SEQUENTIAL);
+    this->data = (char *)p;
+    this->mapped = true;
+  }
+  ::close(fd);
+  return true;
+#else
+  std::FILE *f = std::fopen(path, "rb");
+  if (f == nullptr)
+    return false;
+  long size = -1;
+  if (std::fseek(f, 0, SEEK_END) == 0)
+    size = std::ftell(f);
+  if (size > 0 && std::fseek(f, 0, SEEK_SET) == 0) {
+    this->data = (char *)std::malloc(size);
+    this->size = std::fread(this->data, 1, size, f);
+  }
+  std::fclose(f);
+  if (size < 0 || this->size != (size_t)size) {
+    this->close();
+    return false;
+  }
+  return true;
+#endif
+}
+
+void MappedFile::close() {
+#if defined(TINYJSON_MMAP)
+  if (this->mapped)
+    munmap(this->data, this->size);
+#endif
+  if (!this->mapped)
+    std::free(this->data);
+  this->data = nullptr;
+  this->size = 0;
+  this->mapped = false;
+}
+
+const char *MappedFile::get_data() { return this->data; }
+
+size_t MappedFile::get_size() { return this->size; }
+
+/************
+ * Document Impl
+ ************/
+
+Parse Document::parse(std::shared_ptr<const std::string> json,
+                      Options options) {
+  this->root.release();
+  this->arena.clear();
+  this->file.close();
+  this->json = json;
+  options.arena = &this->arena;
+  return this->root.parse(json, options);
+}
+
+Parse Document::parse(const char *json, size_t len, Options options) {
+  this->root.release();
+  this->arena.clear();
+  this->file.close();
+  this->json = nullptr;
+  options.arena = &this->arena;
+  return this->root.parse(json, len, options);
+}
+
+Parse Document::parse_file(const char *path, Options options) {
+  this->root.release();
+  this->arena.clear();
+  this->json = nullptr;
+  if (!this->file.open(path))
+    return Parse::FILE_ERROR;
+  options.arena = &this->arena;
+  return this->root.parse(this->file.get_data(), this->file.get_size(),
+                          options);
+}
+
+/************
+ * Parser Impl
+ ************/
+
+Parser::Parser(const Options &options) : options(options) {
+  this->options.arena = &this->arena;
+}
+
+Parse Parser::parse(const char *json, size_t len) {
+  this->reset();
+  return this->c.parse_document(this->root, json, len, this->options);
+}
+
+Parse Parser::parse(std::string_view json) {
+  return this->parse(json.data(), json.size());
+}
+
+void Parser::reset() {
+  this->root.release();
+  this->arena.reset();
+}
+
+/************
+ * Batch Impl
+ ************/
+
+size_t Batch::parse(std::shared_ptr<const std::string> json, unsigned threads,
+                    const Options &options) {
+  const char *cstr = json->c_str(), *end = cstr + json->size();
+  this->json = json;
+  this->offsets.clear();
+  this->ends.clear();
+  for (const char *p = cstr; p < end;) {
+    const char *eol = (const char *)std::memchr(p, '\n', end - p);
+    if (eol == nullptr)
+      eol = end;
+    const char *start = skip_whitespace(p, eol);
+    if (start != eol) {
+      /* CRLF line endings are part of the line break, not of the record */
+      this->offsets.push_back(start - cstr);
+      this->ends.push_back(eol - cstr - (eol[-1] == '\r'));
+    }
+    p = eol + 1;
+  }
+
+  size_t size = this->offsets.size();
+  this->values.clear();
+  this->values.resize(size);
+  this->errors.assign(size, Parse::OK);
+
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  /* one thread per grain at most, and the calling thread even for none */
+  threads = std::min<size_t>(
+      threads, std::max<size_t>(1, (size + BATCH_GRAIN_SIZE - 1) /
+                                       BATCH_GRAIN_SIZE));
+  while (this->arenas.size() < threads)
+    this->arenas.push_back(std::make_unique<Arena>());
+  for (auto &arena : this->arenas)
+    arena->clear();
+
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  std::vector<Stats> stats(options.stats != nullptr ? threads : 0);
+  for (unsigned t = 1; t < threads; t++)
+    workers.emplace_back(&Batch::parse_records, this, &next,
+                         this->arenas[t].get(), std::cref(options),
+                         stats.empty() ? nullptr : &stats[t]);
+  this->parse_records(&next, this->arenas[0].get(), options,
+                      stats.empty() ? nullptr : &stats[0]);
+  for (auto &worker : workers)
+    worker.join();
+#ifdef TINYJSON_STATS
+  for (unsigned t = 0; t < stats.size(); t++) {
+    stats[t].allocations += this->arenas[t]->get_block_count();
+    options.stats->add(stats[t]);
+  }
+#endif
+
+  return size - std::count(this->errors.begin(), this->errors.end(),
+                           Parse::OK);
+}
+
+void Batch::parse_records(std::atomic<size_t> *next, Arena *arena,
+                          const Options &options, Stats *stats) {
+  Context c;
+  c.stats = stats;
+  c.arena = arena;
+  c.zero_copy = options.zero_copy;
+  c.intern = options.intern;
+  c.intern_values = options.intern_values;
+  c.intern_shared = true;
+  c.iterative = options.engine != ENGINE_RECURSIVE;
+  c.max_depth = options.max_depth;
+  const char *cstr = this->json->c_str();
+  size_t size = this->offsets.size();
+
+  for (;;) {
+    size_t first = next->fetch_add(BATCH_GRAIN_SIZE);
+    if (first >= size)
+      break;
+    size_t last = std::min<size_t>(first + BATCH_GRAIN_SIZE, size);
+    for (size_t i = first; i < last; i++) {
+      /* the context sees only this line, so a record cannot run on */
+      c.json = cstr + this->offsets[i];
+      c.json_len = this->ends[i] - this->offsets[i];
+      c.offset = 0;
+      Parse ret = c.parse_root(this->values[i]);
+      STATS(&c, stats->bytes += c.offset);
+      if (ret == Parse::OK) {
+        c.parse_whitespace();
+        if ((size_t)c.offset != c.json_len) {
+          this->values[i].release();
+          ret = Parse::ROOT_NOT_SINGULAR;
+        }
+      }
+      this->errors[i] = ret;
+    }
+  }
+}
+
+size_t Batch::get_size() { return this->offsets.size(); }
+
+/************
+ * Cursor Impl
+ ************/
+
+/*
+ * Moves `c` past the value it is at. Arrays and objects are only matched
+ * bracket for bracket, with the brackets inside strings masked out as
+ * split_array() does it, so nothing inside them is checked.
+ */
+static Parse skip_value(Context &c) {
+  const char *cstr = c.json, *end = cstr + c.json_len;
+  char ch = c.at(c.offset);
+  if (ch == '[' || ch == '{') {
+    size_t nsplits;
+    size_t close = split_array(cstr, c.json_len, c.offset, 1, nullptr,
+                               &nsplits);
+    if (close == c.json_len)
+      return ch == '[' ? Parse::MISS_COMMA_OR_SQUARE_BRACKET
+                       : Parse::MISS_COMMA_OR_CURLY_BRACKET;
+    c.offset = close + 1;
+    return Parse::OK;
+  }
+  if (ch == '\"') {
+    const char *p = cstr + c.offset + 1;
+    for (;;) {
+      p = scan_string_chars(p, end);
+      if (p == end)
+        return Parse::MISS_QUOTATION_MARK;
+      if (*p == '\"') {
+        c.offset = p + 1 - cstr;
+        return Parse::OK;
+      }
+      if (*p != '\\')
+        return Parse::INVALID_STRING_CHAR;
+      if (end - p < 2)
+        return Parse::MISS_QUOTATION_MARK;
+      p += 2;
+    }
+  }
+  /* numbers and literals are short and never allocate */
+  Value v;
+  return c.parse_value(v);
+}
+
+Cursor::Cursor() noexcept {
+  this->json = nullptr;
+  this->json_len = this->pos = 0;
+  this->error = Parse::EXPECT_VALUE;
+}
+
+Cursor::Cursor(const char *json, size_t len) noexcept {
+  this->json = json;
+  this->json_len = len;
+  this->pos = skip_whitespace(json, json + len) - json;
+  this->error = this->pos == len ? Parse::EXPECT_VALUE : Parse::OK;
+}
+
+Cursor::Cursor(std::string_view json) noexcept
+    : Cursor(json.data(), json.size()) {}
+
+Cursor::Cursor(const Cursor &from, size_t pos, Parse error) noexcept {
+  this->json = from.json;
+  this->json_len = from.json_len;
+  this->pos = pos;
+  this->error = error;
+}
+
+void Cursor::enter(Context &c, size_t offset) {
+  c.json = this->json;
+  c.json_len = this->json_len;
+  c.offset = offset;
+}
+
+Cursor Cursor::operator[](std::string_view key) {
+  if (!this->is_found() || this->json[this->pos] != '{')
+    return Cursor(*this, this->json_len, this->error);
+  Context c;
+  this->enter(c, this->pos + 1);
+  c.parse_whitespace();
+  if (c.at(c.offset) == '}')
+    return Cursor(*this, this->json_len, Parse::OK);
+  for (;;) {
+    std::string_view name;
+    Parse ret;
+    if (c.at(c.offset) != '\"')
+      return Cursor(*this, this->json_len, Parse::MISS_KEY);
+    if ((ret = c.parse_string_view(&name)) != Parse::OK)
+      return Cursor(*this, this->json_len, ret);
+    bool match = name == key;
+    c.parse_whitespace();
+    if (c.at(c.offset) != ':')
+      return Cursor(*this, this->json_len, Parse::MISS_COLON);
+    c.offset++;
+    c.parse_whitespace();
+    if (match)
+      return Cursor(*this, c.offset, Parse::OK);
+    if ((ret = skip_value(c)) != Parse::OK)
+      return Cursor(*this, this->json_len, ret);
+    c.parse_whitespace();
+    char ch = c.at(c.offset);
+    if (ch == '}')
+      return Cursor(*this, this->json_len, Parse::OK);
+    if (ch != ',')
+      return Cursor(*this, this->json_len,
+                    Parse::MISS_COMMA_OR_CURLY_BRACKET);
+    c.offset++;
+    c.parse_whitespace();
+  }
+}
+
+Cursor Cursor::operator[](size_t index) {
+  if (!this->is_found() || this->json[this->pos] != '[')
+    return Cursor(*this, this->json_len, this->error);
+  Context c;
+  this->enter(c, this->pos + 1);
+  c.parse_whitespace();
+  if (c.at(c.offset) == ']')
+    return Cursor(*this, this->json_len, Parse::OK);
+  for (size_t i = 0;; i++) {
+    Parse ret;
+    if (i == index)
+      return Cursor(*this, c.offset, Parse::OK);
+    if ((ret = skip_value(c)) != Parse::OK)
+      return Cursor(*this, this->json_len, ret);
+    c.parse_whitespace();
+    char ch = c.at(c.offset);
+    if (ch == ']')
+      return Cursor(*this, this->json_len, Parse::OK);
+    if (ch != ',')
+      return Cursor(*this, this->json_len,
+                    Parse::MISS_COMMA_OR_SQUARE_BRACKET);
+    c.offset++;
+    c.parse_whitespace();
+  }
+}
+
+bool Cursor::is_found() {
+  return this->error == Parse::OK && this->pos < this->json_len;
+}
+
+Parse Cursor::get_error() { return this->error; }
+
+Type Cursor::get_type() {
+  assert(this->is_found());
+  switch (this->json[this->pos]) {
+  case 'n':
+    return Type::NIL;
+  case 't':
+    return Type::TRUE;
+  case 'f':
+    return Type::FALSE;
+  case '\"':
+    return Type::STRING;
+  case '[':
+    return Type::ARRAY;
+  case '{':
+    return Type::OBJECT;
+  default:
+    return Type::NUMBER;
+  }
+}
+
+std::string_view Cursor::get_raw() {
+  if (!this->is_found())
+    return std::string_view();
+  Context c;
+  this->enter(c, this->pos);
+  if ((this->error = skip_value(c)) != Parse::OK)
+    return std::string_view();
+  return std::string_view(this->json + this->pos, c.offset - this->pos);
+}
+
+Parse Cursor::get_value(Value &v, const Options &options) {
+  v.release();
+  if (!this->is_found())
+    return this->error != Parse::OK ? this->error : Parse::EXPECT_VALUE;
+  return this->error = v.parse(this->json + this->pos,
+                               this->json_len - this->pos, options);
+}
+
+Parse Cursor::decode(Value &v) {
+  if (!this->is_found())
+    return Parse::EXPECT_VALUE;
+  Context c;
+  this->enter(c, this->pos);
+  return this->error = c.parse_value(v);
+}
+
+bool Cursor::get_boolean() {
+  assert(!this->is_found() || this->get_type() == Type::TRUE ||
+         this->get_type() == Type::FALSE);
+  Value v;
+  return this->decode(v) == Parse::OK && v.get_boolean();
+}
+
+double Cursor::get_number() {
+  assert(!this->is_found() || this->get_type() == Type::NUMBER);
+  Value v;
+  return this->decode(v) == Parse::OK ? v.get_number() : 0.0;
+}
+
+int64_t Cursor::get_int64() {
+  assert(!this->is_found() || this->get_type() == Type::NUMBER);
+  Value v;
+  return this->decode(v) == Parse::OK ? v.get_int64() : 0;
+}
+
+uint64_t Cursor::get_uint64() {
+  assert(!this->is_found() || this->get_type() == Type::NUMBER);
+  Value v;
+  return this->decode(v) == Parse::OK ? v.get_uint64() : 0;
+}
+
+std::string Cursor::get_string() {
+  assert(!this->is_found() || this->get_type() == Type::STRING);
+  std::string_view str;
+  if (!this->is_found())
+    return std::string();
+  /* unlike a Value, the view needs no copy of a string without escapes */
+  Context c;
+  this->enter(c, this->pos);
+  if ((this->error = c.parse_string_view(&str)) != Parse::OK)
+    return std::string();
+  return std::string(str);
+}
+
+/************
+ * Projection Impl
+ ************/
+
+Projection::Projection() {
+  this->nodes.push_back(Node{"", false, SIZE_MAX, {}, {}});
+  this->size = 0;
+}
+
+bool Projection::add(std::string_view pointer) {
+  std::vector<std::string> tokens;
+  if (!pointer.empty() && pointer[0] != '/')
+    return false;
+  for (size_t i = 0; i < pointer.size();) {
+    size_t end = pointer.find('/', i + 1);
+    if (end == std::string_view::npos)
+      end = pointer.size();
+    std::string token;
+    for (size_t j = i + 1; j < end; j++) {
+      if (pointer[j] != '~') {
+        token += pointer[j];
+      } else if (j + 1 < end && (pointer[j + 1] == '0' ||
+                                 pointer[j + 1] == '1')) {
+        token += pointer[++j] == '0' ? '~' : '/';
+      } else {
+        return false;
+      }
+    }
+    tokens.push_back(std::move(token));
+    i = end;
+  }
+
+  size_t node = 0;
+  for (auto &token : tokens) {
+    size_t next = 0;
+    for (size_t child : this->nodes[node].children) {
+      if (this->nodes[child].token == token) {
+        next = child;
+        break;
+      }
+    }
+    if (next == 0) {
+      /* array indexes are digits without a leading zero */
+      size_t index = SIZE_MAX;
+      auto r = std::from_chars(token.data(), token.data() + token.size(),
+                               index);
+      if (token.empty() || (token[0] == '0' && token.size() > 1) ||
+          r.ec != std::errc() || r.ptr != token.data() + token.size())
+        index = SIZE_MAX;
+      next = this->nodes.size();
+      this->nodes.push_back(Node{token, token == "*", index, {}, {}});
+      this->nodes[node].children.push_back(next);
+    }
+    node = next;
+  }
+  this->nodes[node].paths.push_back(this->size++);
+  return true;
+}
+
+size_t Projection::get_size() { return this->size; }
+
+/*
+ * Walks the value at the context's offset, which the nodes active[first,
+ * last) are at: it is decoded once for each path ending at one of them, and
+ * walked into if a path goes on under it, or else skipped.
+ */
+Parse Projection::walk(size_t first, size_t last) {
+  Context &c = this->c;
+  int64_t start = c.offset;
+  bool inside = false, parsed = false;
+  Parse ret;
+  for (size_t i = first; i < last; i++) {
+    Node &node = this->nodes[this->active[i]];
+    for (size_t path : node.paths) {
+      Value v;
+      c.offset = start;
+      if ((ret = c.parse_root(v)) != Parse::OK)
+        return ret;
+      /* moved onto the stack, so `v` must not release it */
+      c.push((const char *)&v, sizeof(Value));
+      v.type = Type::NIL;
+      this->matched.push_back(path);
+      parsed = true;
+    }
+    inside = inside || !node.children.empty();
+  }
+  char ch = c.at(start);
+  if (!inside || (ch != '{' && ch != '[')) {
+    if (parsed)
+      return Parse::OK;
+    c.offset = start;
+    return skip_value(c);
+  }
+
+  c.offset = start + 1;
+  c.parse_whitespace();
+  if (c.at(c.offset) == (ch == '{' ? '}' : ']')) {
+    c.offset++;
+    return Parse::OK;
+  }
+  for (size_t index = 0;; index++) {
+    std::string_view key;
+    if (ch == '{') {
+      if (c.at(c.offset) != '\"')
+        return Parse::MISS_KEY;
+      if ((ret = c.parse_string_view(&key)) != Parse::OK)
+        return ret;
+      c.parse_whitespace();
+      if (c.at(c.offset) != ':')
+        return Parse::MISS_COLON;
+      c.offset++;
+      c.parse_whitespace();
+    }
+    if ((ret = this->match(first, last, key,
+                           ch == '[' ? index : SIZE_MAX)) != Parse::OK)
+      return ret;
+    c.parse_whitespace();
+    if (c.at(c.offset) == ',') {
+      c.offset++;
+      c.parse_whitespace();
+    } else if (c.at(c.offset) == (ch == '{' ? '}' : ']')) {
+      c.offset++;
+      return Parse::OK;
+    } else {
+      return ch == '{' ? Parse::MISS_COMMA_OR_CURLY_BRACKET
+                       : Parse::MISS_COMMA_OR_SQUARE_BRACKET;
+    }
+  }
+}
+
+/* Walks a member named `key`, or the element at `index`, of the value. */
+Parse Projection::match(size_t first, size_t last, std::string_view key,
+                        size_t index) {
+  size_t next = this->active.size();
+  for (size_t i = first; i < last; i++) {
+    for (size_t child : this->nodes[this->active[i]].children) {
+      Node &node = this->nodes[child];
+      if (node.wildcard ||
+          (index == SIZE_MAX ? node.token == key : node.index == index))
+        this->active.push_back(child);
+    }
+  }
+  Parse ret = next == this->active.size()
+                  ? skip_value(this->c)
+                  : this->walk(next, this->active.size());
+  this->active.resize(next);
+  return ret;
+}
+
+Parse Projection::extract(const char *json, size_t len, Value &out,
+                          const Options &options) {
+  Context &c = this->c;
+  c.json = json;
+  c.json_len = len;
+  c.offset = 0;
+  c.arena = options.arena;
+  c.zero_copy = options.zero_copy;
+  c.intern = options.intern;
+  c.intern_values = options.intern_values;
+  c.iterative = options.engine != ENGINE_RECURSIVE;
+  c.max_depth = options.max_depth;
+  out.release();
+  this->active.assign(1, 0);
+  this->matched.clear();
+
+  c.parse_whitespace();
+  Parse ret = this->walk(0, 1);
+  if (ret != Parse::OK) {
+    c.pop_values(this->matched.size());
+    return ret;
+  }
+
+  /* the matches are on the stack in document order, sort them by path */
+  this->counts.assign(this->size, 0);
+  for (size_t path : this->matched)
+    this->counts[path]++;
+  out.type = Type::ARRAY;
+  out.flags = c.arena != nullptr ? FLAG_ARENA : 0;
+  out.len = this->size;
+  out.elems = this->size == 0 ? nullptr
+                              : (Value *)c.alloc(this->size * sizeof(Value),
+                                                 alignof(Value));
+  for (size_t p = 0; p < this->size; p++) {
+    Value *v = new (&out.elems[p]) Value();
+    v->type = Type::ARRAY;
+    v->flags = out.flags;
+    v->len = this->counts[p];
+    v->elems = v->len == 0 ? nullptr
+                           : (Value *)c.alloc(v->len * sizeof(Value),
+                                              alignof(Value));
+    this->counts[p] = 0;
+  }
+  size_t n = this->matched.size();
+  const Value *values = (const Value *)c.pop(n * sizeof(Value));
+  for (size_t i = 0; i < n; i++) {
+    Value &v = out.elems[this->matched[i]];
+    std::memcpy((void *)&v.elems[this->counts[this->matched[i]]++],
+                (const void *)&values[i], sizeof(Value));
+  }
+  return Parse::OK;
+}
+
+Parse Projection::extract(std::string_view json, Value &out,
+                          const Options &options) {
+  return this->extract(json.data(), json.size(), out, options);
+}
+
+/************
+ * Binary Impl
+ ************/
+
+/*
+ * A 16-byte header, "TJB" and a version byte, BINARY_BYTE_ORDER and the size
+ * of the whole buffer, comes first, then the root slot. A slot is laid out
+ * as a Value, with an offset where the pointer goes and FLAG_INLINE its only
+ * flag. Out-of-line blocks follow the slot pointing at them, in the order
+ * encode_slot() visits the tree, and blocks of slots are 8-byte aligned.
+ *
+ * Everything is in the byte order of the host that encoded it, which is
+ * what lets a reader take numbers and offsets as they are; a buffer from a
+ * host of the other byte order is refused rather than swapped. Every value
+ * takes a whole slot, and every member two, so the encoding is larger than
+ * the text it came from: about 2.2 times for the bench payload of short
+ * keys, numbers and small arrays. What that buys is reading in place.
+ */
+static constexpr char BINARY_MAGIC[4] = {'T', 'J', 'B', 2};
+/* reads back as 0x04030201 on a host of the other byte order */
+static constexpr uint32_t BINARY_BYTE_ORDER = 0x01020304;
+static constexpr size_t BINARY_HEADER_SIZE = 16;
+static constexpr size_t BINARY_SLOT_SIZE = 16;
+
+struct BinarySlot {
+  union {
+    struct {
+      union {
+        double n;
+        int64_t i;
+        uint64_t u;
+        uint64_t offset;
+      };
+      uint32_t len;
+      uint8_t ss_len;
+      uint8_t flags;
+      Type type;
+      Number subtype;
+    };
+    char ss[Value::SSO_CAPACITY];
+  };
+};
+
+static_assert(sizeof(BinarySlot) == BINARY_SLOT_SIZE,
+              "a slot must have the size of a Value");
+
+/* slots may sit at any address in a mapping, so they are copied out */
+static inline BinarySlot read_slot(const char *data, size_t pos) {
+  BinarySlot s;
+  std::memcpy((void *)&s, data + pos, sizeof(BinarySlot));
+  return s;
+}
+
+static inline Value number_value(const BinarySlot &s) {
+  Value v;
+  v.type = Type::NUMBER;
+  v.subtype = s.subtype;
+  v.u = s.u;
+  return v;
+}
+
+/*
+ * Writes the slot of `v` at `pos`, and what it points at after the end.
+ * Objects sort their member indexes on top of `order`.
+ */
+static void encode_slot(std::string &out, size_t pos, Value &v,
+                        std::vector<uint32_t> &order) {
+  BinarySlot s;
+  std::memset((void *)&s, 0, sizeof(BinarySlot));
+  s.type = v.type;
+  switch (v.type) {
+  case Type::NUMBER:
+    s.u = v.u;
+    s.subtype = v.subtype;
+    break;
+  case Type::STRING: {
+    std::string_view str = v.get_string_view();
+    if (str.size() <= Value::SSO_CAPACITY) {
+      std::memcpy(s.ss, str.data(), str.size());
+      s.ss_len = str.size();
+      s.flags = FLAG_INLINE;
+    } else {
+      s.offset = out.size();
+      s.len = str.size();
+      out.append(str);
+    }
+    break;
+  }
+  case Type::ARRAY:
+  case Type::OBJECT: {
+    if (v.len == 0)
+      break;
+    size_t n = v.type == Type::ARRAY ? v.len : 2 * v.len;
+    size_t at = (out.size() + 7) & ~(size_t)7;
+    out.resize(at + n * BINARY_SLOT_SIZE);
+    s.offset = at;
+    s.len = v.len;
+    if (v.type == Type::ARRAY) {
+      for (size_t i = 0; i < v.len; i++)
+        encode_slot(out, at + i * BINARY_SLOT_SIZE, v.elems[i], order);
+      break;
+    }
+    size_t base = order.size();
+    for (size_t i = 0; i < v.len; i++)
+      order.push_back(i);
+    /* equal keys keep their order, with no buffer for a stable sort */
+    std::sort(order.begin() + base, order.end(), [&](uint32_t a, uint32_t b) {
+      int cmp = v.members[a].key.get_string_view().compare(
+          v.members[b].key.get_string_view());
+      return cmp < 0 || (cmp == 0 && a < b);
+    });
+    for (size_t i = 0; i < v.len; i++) {
+      Member &m = v.members[order[base + i]];
+      encode_slot(out, at + 2 * i * BINARY_SLOT_SIZE, m.key, order);
+      encode_slot(out, at + (2 * i + 1) * BINARY_SLOT_SIZE, m.value, order);
+    }
+    order.resize(base);
+    break;
+  }
+  default:
+    break;
+  }
+  std::memcpy(&out[pos], (const void *)&s, sizeof(BinarySlot));
+}
+
+/*
+ * Checks the slot at `pos` and everything under it. Every block must start
+ * at or after `frontier`, which then moves past it, so no two nodes share
+ * bytes and nothing points back up the tree.
+ */
+static Parse validate_slot(const char *data, size_t size, size_t pos,
+                           size_t *frontier, unsigned depth) {
+  BinarySlot s = read_slot(data, pos);
+  switch (s.type) {
+  case Type::NIL:
+  case Type::FALSE:
+  case Type::TRUE:
+    return Parse::OK;
+  case Type::NUMBER:
+    return s.subtype <= Number::NUMBER_UINT64 ? Parse::OK
+                                              : Parse::INVALID_BINARY;
+  case Type::STRING:
+    if (s.flags & FLAG_INLINE)
+      return s.ss_len <= Value::SSO_CAPACITY ? Parse::OK
+                                             : Parse::INVALID_BINARY;
+    if (s.offset < *frontier || s.offset > size || s.len > size - s.offset)
+      return Parse::INVALID_BINARY;
+    *frontier = s.offset + s.len;
+    return Parse::OK;
+  case Type::ARRAY:
+  case Type::OBJECT: {
+    if (depth == 0)
+      return Parse::NESTING_TOO_DEEP;
+    if (s.len == 0)
+      return Parse::OK;
+    size_t n = s.type == Type::ARRAY ? s.len : 2 * (size_t)s.len;
+    if (s.offset < *frontier || s.offset > size ||
+        n > (size - s.offset) / BINARY_SLOT_SIZE)
+      return Parse::INVALID_BINARY;
+    *frontier = s.offset + n * BINARY_SLOT_SIZE;
+    for (size_t i = 0; i < n; i++) {
+      Parse ret = validate_slot(data, size, s.offset + i * BINARY_SLOT_SIZE,
+                                frontier, depth - 1);
+      if (ret != Parse::OK)
+        return ret;
+    }
+    if (s.type == Type::OBJECT) {
+      /* find_member() relies on the keys being strings in order */
+      BinaryValue v(data, pos);
+      for (size_t i = 0; i < s.len; i++) {
+        if (read_slot(data, s.offset + 2 * i * BINARY_SLOT_SIZE).type !=
+                Type::STRING ||
+            (i > 0 &&
+             v.get_object_key_view(i) < v.get_object_key_view(i - 1)))
+          return Parse::INVALID_BINARY;
+      }
+    }
+    return Parse::OK;
+  }
+  default:
+    return Parse::INVALID_BINARY;
+  }
+}
+
+BinaryValue::BinaryValue() noexcept {
+  this->data = nullptr;
+  this->pos = 0;
+}
+
+BinaryValue::BinaryValue(const char *data, size_t pos) noexcept {
+  this->data = data;
+  this->pos = pos;
+}
+
+bool BinaryValue::is_found() const { return this->data != nullptr; }
+
+Type BinaryValue::get_type() const {
+  return this->data != nullptr ? read_slot(this->data, this->pos).type
+                               : Type::NIL;
+}
+
+bool BinaryValue::get_boolean() const {
+  Type type = this->get_type();
+  assert(type == Type::TRUE || type == Type::FALSE);
+  return type == Type::TRUE;
+}
+
+double BinaryValue::get_number() const {
+  return number_value(read_slot(this->data, this->pos)).get_number();
+}
+
+int64_t BinaryValue::get_int64() const {
+  return number_value(read_slot(this->data, this->pos)).get_int64();
+}
+
+uint64_t BinaryValue::get_uint64() const {
+  return number_value(read_slot(this->data, this->pos)).get_uint64();
+}
+
+Number BinaryValue::get_number_type() const {
+  assert(this->get_type() == Type::NUMBER);
+  return read_slot(this->data, this->pos).subtype;
+}
+
+size_t BinaryValue::get_string_len() const {
+  BinarySlot s = read_slot(this->data, this->pos);
+  assert(s.type == Type::STRING);
+  return s.flags & FLAG_INLINE ? s.ss_len : s.len;
+}
+
+const char *BinaryValue::get_string_data() const {
+  BinarySlot s = read_slot(this->data, this->pos);
+  assert(s.type == Type::STRING);
+  return s.flags & FLAG_INLINE ? this->data + this->pos
+                               : this->data + s.offset;
+}
+
+std::string BinaryValue::get_string() const {
+  return std::string(this->get_string_view());
+}
+
+std::string_view BinaryValue::get_string_view() const {
+  return std::string_view(this->get_string_data(), this->get_string_len());
+}
+
+size_t BinaryValue::get_array_size() const {
+  BinarySlot s = read_slot(this->data, this->pos);
+  assert(s.type == Type::ARRAY);
+  return s.len;
+}
+
+BinaryValue BinaryValue::get_array_elem(size_t index) const {
+  BinarySlot s = read_slot(this->data, this->pos);
+  assert(s.type == Type::ARRAY && index < s.len);
+  return BinaryValue(this->data, s.offset + index * BINARY_SLOT_SIZE);
+}
+
+size_t BinaryValue::get_object_size() const {
+  BinarySlot s = read_slot(this->data, this->pos);
+  assert(s.type == Type::OBJECT);
+  return s.len;
+}
+
+BinaryValue BinaryValue::get_object_value(size_t index) const {
+  BinarySlot s = read_slot(this->data, this->pos);
+  assert(s.type == Type::OBJECT && index < s.len);
+  return BinaryValue(this->data, s.offset + (2 * index + 1) * BINARY_SLOT_SIZE);
+}
+
+std::string BinaryValue::get_object_key(size_t index) const {
+  return std::string(this->get_object_key_view(index));
+}
+
+std::string_view BinaryValue::get_object_key_view(size_t index) const {
+  BinarySlot s = read_slot(this->data, this->pos);
+  assert(s.type == Type::OBJECT && index < s.len);
+  return BinaryValue(this->data, s.offset + 2 * index * BINARY_SLOT_SIZE)
+      .get_string_view();
+}
+
+size_t BinaryValue::get_object_key_len(size_t index) const {
+  return this->get_object_key_view(index).size();
+}
+
+BinaryValue BinaryValue::find_member(std::string_view key) const {
+  if (this->get_type() != Type::OBJECT)
+    return BinaryValue();
+  /* the first key not less than `key` */
+  size_t lo = 0, hi = this->get_object_size();
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (this->get_object_key_view(mid) < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == this->get_object_size() || this->get_object_key_view(lo) != key)
+    return BinaryValue();
+  return this->get_object_value(lo);
+}
+
+void BinaryValue::get_value(Value &v, Arena *arena) const {
+  v.release();
+  if (this->data == nullptr)
+    return;
+  BinarySlot s = read_slot(this->data, this->pos);
+  switch (s.type) {
+  case Type::NUMBER:
+    v.u = s.u;
+    v.subtype = s.subtype;
+    v.type = Type::NUMBER;
+    return;
+  case Type::STRING: {
+    std::string_view str = this->get_string_view();
+    v.set_cstring(str.data(), str.size(), arena);
+    return;
+  }
+  case Type::ARRAY:
+    v.elems = s.len == 0 ? nullptr
+                         : (Value *)copy_alloc(arena, s.len * sizeof(Value),
+                                               alignof(Value));
+    for (size_t i = 0; i < s.len; i++)
+      new (&v.elems[i]) Value();
+    break;
+  case Type::OBJECT:
+    v.members = s.len == 0
+                    ? nullptr
+                    : (Member *)copy_alloc(arena,
+                                           s.len * sizeof(Member) +
+                                               member_index_size(s.len),
+                                           alignof(Member));
+    for (size_t i = 0; i < s.len; i++)
+      new (&v.members[i]) Member();
+    break;
+  default:
+    v.type = s.type;
+    return;
+  }
+  v.type = s.type;
+  v.flags = arena != nullptr ? FLAG_ARENA : 0;
+  v.len = s.len;
+  if (v.type == Type::ARRAY) {
+    for (size_t i = 0; i < v.len; i++)
+      this->get_array_elem(i).get_value(v.elems[i], arena);
+  } else {
+    for (size_t i = 0; i < v.len; i++) {
+      BinaryValue(this->data, s.offset + 2 * i * BINARY_SLOT_SIZE)
+          .get_value(v.members[i].key, arena);
+      this->get_object_value(i).get_value(v.members[i].value, arena);
+    }
+    index_members(v);
+  }
+}
+
+std::string BinaryValue::stringify() const {
+  Context c;
+  size_t len;
+  const char *json = c.stringify(*this, &len);
+  return std::string(json, len);
+}
+
+BinaryDocument::BinaryDocument() noexcept {
+  this->data = nullptr;
+  this->size = 0;
+}
+
+void BinaryDocument::encode(Value &v) {
+  this->file.close();
+  this->buffer.assign(BINARY_HEADER_SIZE + BINARY_SLOT_SIZE, '\0');
+  std::memcpy(&this->buffer[0], BINARY_MAGIC, sizeof(BINARY_MAGIC));
+  std::memcpy(&this->buffer[4], &BINARY_BYTE_ORDER, sizeof(uint32_t));
+  std::vector<uint32_t> order;
+  encode_slot(this->buffer, BINARY_HEADER_SIZE, v, order);
+  uint64_t size = this->buffer.size();
+  std::memcpy(&this->buffer[8], &size, sizeof(size));
+  this->data = this->buffer.data();
+  this->size = this->buffer.size();
+}
+
+Parse BinaryDocument::parse(const char *json, size_t len,
+                            const Options &options) {
+  /* the tree only lives until it is encoded, so it can borrow the input */
+  Arena arena;
+  Options o = options;
+  o.arena = &arena;
+  o.zero_copy = true;
+  Value v;
+  Parse ret = v.parse(json, len, o);
+  if (ret != Parse::OK) {
+    this->file.close();
+    this->buffer.clear();
+    this->data = nullptr;
+    this->size = 0;
+    return ret;
+  }
+  this->encode(v);
+  return Parse::OK;
+}
+
+Parse BinaryDocument::parse(std::string_view json, const Options &options) {
+  return this->parse(json.data(), json.size(), options);
+}
+
+Parse BinaryDocument::attach(const char *data, size_t size) {
+  uint64_t stored = 0;
+  uint32_t order = 0;
+  if (size >= BINARY_HEADER_SIZE + BINARY_SLOT_SIZE) {
+    std::memcpy(&order, data + 4, sizeof(order));
+    std::memcpy(&stored, data + 8, sizeof(stored));
+  }
+  if (stored < BINARY_HEADER_SIZE + BINARY_SLOT_SIZE || stored > size ||
+      std::memcmp(data, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0 ||
+      order != BINARY_BYTE_ORDER) {
+    this->data = nullptr;
+    this->size = 0;
+    return Parse::INVALID_BINARY;
+  }
+  this->data = data;
+  this->size = stored;
+  return Parse::OK;
+}
+
+Parse BinaryDocument::open(const char *data, size_t size) {
+  this->file.close();
+  this->buffer.clear();
+  return this->attach(data, size);
+}
+
+Parse BinaryDocument::open_file(const char *path) {
+  this->buffer.clear();
+  if (!this->file.open(path)) {
+    this->data = nullptr;
+    this->size = 0;
+    return Parse::FILE_ERROR;
+  }
+  return this->attach(this->file.get_data(), this->file.get_size());
+}
+
+Parse BinaryDocument::validate(unsigned max_depth) {
+  if (this->data == nullptr)
+    return Parse::INVALID_BINARY;
+  size_t frontier = BINARY_HEADER_SIZE + BINARY_SLOT_SIZE;
+  return validate_slot(this->data, this->size, BINARY_HEADER_SIZE, &frontier,
+                       max_depth);
+}
+
+const char *BinaryDocument::get_data() { return this->data; }
+
+size_t BinaryDocument::get_size() { return this->size; }
+
+BinaryValue BinaryDocument::get_root() {
+  if (this->data == nullptr)
+    return BinaryValue();
+  return BinaryValue(this->data, BINARY_HEADER_SIZE);
+}
+
+std::string BinaryDocument::stringify() { return this->get_root().stringify(); }
+
+/************
+ * Tape Impl
+ ************/
+
+static constexpr uint64_t TAPE_PAYLOAD_MASK = ((uint64_t)1 << 56) - 1;
+
+static inline uint64_t tape_word(char tag, uint64_t payload) {
+  return (uint64_t)(uint8_t)tag << 56 | payload;
+}
+
+static inline char tape_tag(uint64_t word) { return (char)(word >> 56); }
+
+/* The SAX handler Tape::parse() writes the tape with. */
+class TapeWriter {
+private:
+  Tape &tape;
+
+  void open(char tag) {
+    this->tape.open.push_back(this->tape.words.size());
+    this->tape.words.push_back(tape_word(tag, 0));
+  }
+
+  void close(char tag, size_t size) {
+    std::vector<uint64_t> &words = this->tape.words;
+    size_t at = this->tape.open.back();
+    this->tape.open.pop_back();
+    /* one past the close word about to be pushed */
+    size_t end = words.size() + 1;
+    if (end > UINT32_MAX) {
+      /* the tape is thrown away, so nothing more needs to be written */
+      this->too_large = true;
+      return;
+    }
+    uint64_t count = std::min(size, Tape::COUNT_MAX);
+    words[at] = tape_word(tape_tag(words[at]), count << 32 | end);
+    words.push_back(tape_word(tag, at));
+  }
+
+public:
+  /* an end offset or a string length did not fit in 32 bits */
+  bool too_large;
+
+  TapeWriter(Tape &tape) : tape(tape) { this->too_large = false; }
+
+  void on_null() { this->tape.words.push_back(tape_word('n', 0)); }
+  void on_bool(bool b) {
+    this->tape.words.push_back(tape_word(b ? 't' : 'f', 0));
+  }
+  void on_number(Value &num) {
+    char tag = num.subtype == Number::NUMBER_INT64    ? 'l'
+               : num.subtype == Number::NUMBER_UINT64 ? 'u'
+                                                      : 'd';
+    this->tape.words.push_back(tape_word(tag, 0));
+    this->tape.words.push_back(num.u);
+  }
+  void on_string(std::string_view str) {
+    std::string &strings = this->tape.strings;
+    if (str.size() > UINT32_MAX) {
+      this->too_large = true;
+      return;
+    }
+    uint32_t len = str.size();
+    this->tape.words.push_back(tape_word('\"', strings.size()));
+    strings.append((const char *)&len, sizeof(len));
+    strings.append(str);
+  }
+  void on_key(std::string_view key) { this->on_string(key); }
+  void on_start_array() { this->open('['); }
+  void on_end_array(size_t size) { this->close(']', size); }
+  void on_start_object() { this->open('{'); }
+  void on_end_object(size_t size) { this->close('}', size); }
+};
+
+Parse Tape::parse(const char *json, size_t len, unsigned max_depth) {
+  this->words.clear();
+  this->strings.clear();
+  this->open.clear();
+  Context &c = this->c;
+  c.json = json;
+  c.json_len = len;
+  c.offset = 0;
+  c.max_depth = max_depth;
+  TapeWriter writer(*this);
+  c.parse_whitespace();
+  /* like Value::parse, nothing after the value is looked at */
+  Parse ret = c.parse_sax_value(writer);
+  if (ret == Parse::OK && writer.too_large)
+    ret = Parse::DOCUMENT_TOO_LARGE;
+  if (ret != Parse::OK) {
+    this->words.clear();
+    this->strings.clear();
+  }
+  return ret;
+}
+
+Parse Tape::parse(std::string_view json, unsigned max_depth) {
+  return this->parse(json.data(), json.size(), max_depth);
+}
+
+TapeValue Tape::get_root() const {
+  return this->words.empty() ? TapeValue() : TapeValue(this, 0);
+}
+
+size_t Tape::get_size() const { return this->words.size(); }
+
+std::string Tape::stringify() const { return this->get_root().stringify(); }
+
+TapeIterator::TapeIterator(const Tape *tape, size_t pos, bool object) noexcept {
+  this->tape = tape;
+  this->pos = pos;
+  this->object = object;
+}
+
+std::string_view TapeIterator::key() const {
+  assert(this->object);
+  return TapeValue(this->tape, this->pos).get_string_view();
+}
+
+TapeValue::TapeValue() noexcept {
+  this->tape = nullptr;
+  this->pos = 0;
+}
+
+TapeValue::TapeValue(const Tape *tape, size_t pos) noexcept {
+  this->tape = tape;
+  this->pos = pos;
+}
+
+bool TapeValue::is_found() const { return this->tape != nullptr; }
+
+bool TapeValue::get_boolean() const {
+  Type type = this->get_type();
+  assert(type == Type::TRUE || type == Type::FALSE);
+  return type == Type::TRUE;
+}
+
+Value TapeValue::get_number_value() const {
+  assert(this->get_type() == Type::NUMBER);
+  Value v;
+  v.type = Type::NUMBER;
+  v.subtype = this->get_number_type();
+  v.u = this->tape->words[this->pos + 1];
+  return v;
+}
+
+double TapeValue::get_number() const {
+  return this->get_number_value().get_number();
+}
+
+int64_t TapeValue::get_int64() const {
+  return this->get_number_value().get_int64();
+}
+
+uint64_t TapeValue::get_uint64() const {
+  return this->get_number_value().get_uint64();
+}
+
+Number TapeValue::get_number_type() const {
+  switch (tape_tag(this->tape->words[this->pos])) {
+  case 'l':
+    return Number::NUMBER_INT64;
+  case 'u':
+    return Number::NUMBER_UINT64;
+  default:
+    assert(this->get_type() == Type::NUMBER);
+    return Number::NUMBER_DOUBLE;
+  }
+}
+
+size_t TapeValue::get_string_len() const {
+  assert(this->get_type() == Type::STRING);
+  uint32_t len;
+  std::memcpy(&len,
+              this->tape->strings.data() +
+                  (this->tape->words[this->pos] & TAPE_PAYLOAD_MASK),
+              sizeof(len));
+  return len;
+}
+
+const char *TapeValue::get_string_data() const {
+  assert(this->get_type() == Type::STRING);
+  return this->tape->strings.data() +
+         (this->tape->words[this->pos] & TAPE_PAYLOAD_MASK) + sizeof(uint32_t);
+}
+
+std::string TapeValue::get_string() const {
+  return std::string(this->get_string_view());
+}
+
+std::string_view TapeValue::get_string_view() const {
+  return std::string_view(this->get_string_data(), this->get_string_len());
+}
+
+size_t TapeValue::get_array_size() const {
+  assert(this->get_type() == Type::ARRAY);
+  size_t size = (this->tape->words[this->pos] & TAPE_PAYLOAD_MASK) >> 32;
+  if (size == Tape::COUNT_MAX) {
+    size = 0;
+    for (TapeIterator it = this->begin(); it != this->end(); ++it)
+      size++;
+  }
+  return size;
+}
+
+size_t TapeValue::get_object_size() const {
+  assert(this->get_type() == Type::OBJECT);
+  size_t size = (this->tape->words[this->pos] & TAPE_PAYLOAD_MASK) >> 32;
+  if (size == Tape::COUNT_MAX) {
+    size = 0;
+    for (TapeIterator it = this->begin(); it != this->end(); ++it)
+      size++;
+  }
+  return size;
+}
+
+TapeValue TapeValue::get_array_elem(size_t index) const {
+  assert(this->get_type() == Type::ARRAY);
+  TapeIterator it = this->begin(), end = this->end();
+  for (; index > 0 && it != end; index--)
+    ++it;
+  return it != end ? *it : TapeValue();
+}
+
+TapeValue TapeValue::find_member(std::string_view key) const {
+  if (this->get_type() != Type::OBJECT)
+    return TapeValue();
+  for (TapeIterator it = this->begin(), end = this->end(); it != end; ++it)
+    if (it.key() == key)
+      return *it;
+  return TapeValue();
+}
+
+TapeIterator TapeValue::begin() const {
+  Type type = this->get_type();
+  assert(type == Type::ARRAY || type == Type::OBJECT);
+  return TapeIterator(this->tape, this->pos + 1, type == Type::OBJECT);
+}
+
+TapeIterator TapeValue::end() const {
+  Type type = this->get_type();
+  assert(type == Type::ARRAY || type == Type::OBJECT);
+  return TapeIterator(this->tape, this->get_next() - 1, type == Type::OBJECT);
+}
+
+void TapeValue::get_value(Value &v, Arena *arena) const {
+  v.release();
+  switch (this->get_type()) {
+  case Type::NUMBER:
+    v = this->get_number_value();
+    return;
+  case Type::STRING: {
+    std::string_view str = this->get_string_view();
+    v.set_cstring(str.data(), str.size(), arena);
+    return;
+  }
+  case Type::ARRAY: {
+    size_t len = this->get_array_size();
+    v.elems = len == 0 ? nullptr
+                       : (Value *)copy_alloc(arena, len * sizeof(Value),
+                                             alignof(Value));
+    v.type = Type::ARRAY;
+    v.flags = arena != nullptr ? FLAG_ARENA : 0;
+    v.len = 0;
+    for (TapeIterator it = this->begin(); it != this->end(); ++it)
+      (*it).get_value(*new (&v.elems[v.len++]) Value(), arena);
+    return;
+  }
+  case Type::OBJECT: {
+    size_t len = this->get_object_size();
+    v.members = len == 0 ? nullptr
+                         : (Member *)copy_alloc(arena,
+                                                len * sizeof(Member) +
+                                                    member_index_size(len),
+                                                alignof(Member));
+    v.type = Type::OBJECT;
+    v.flags = arena != nullptr ? FLAG_ARENA : 0;
+    v.len = 0;
+    for (TapeIterator it = this->begin(); it != this->end(); ++it) {
+      Member *m = new (&v.members[v.len++]) Member();
+      std::string_view key = it.key();
+      m->key.set_cstring(key.data(), key.size(), arena);
+      (*it).get_value(m->value, arena);
+    }
+    index_members(v);
+    return;
+  }
+  default:
+    v.type = this->get_type();
+    return;
+  }
+}
+
+std::string TapeValue::stringify() const {
+  Context c;
+  size_t len;
+  const char *json = c.stringify(*this, &len);
+  return std::string(json, len);
+}
+
+/************
+ * Content Impl
+ ************/
+
+void Context::stack_grow() {
+  if (this->size != 0)
+    this->size += this->size >> 1; /* size = size * 1.5 */
+  else
+    this->size = CONTEXT_STACK_INIT_SIZE;
+  this->stack = (char *)std::realloc(this->stack, this->size);
+  STATS(this, stats->stack_grows++, stats->allocations++);
+}
+
+void Context::stack_grow_size(size_t len) {
+  STATS(this, stats->stack_peak = std::max(stats->stack_peak, this->top + len));
+  while (this->top + len > this->size)
+    this->stack_grow();
+}
+
+Context::Context() noexcept {
+  this->offset = 0;
+  this->json = nullptr;
+  this->json_len = 0;
+  this->arena = nullptr;
+  this->recycler = nullptr;
+  this->zero_copy = false;
+  this->intern = nullptr;
+  this->intern_values = false;
+  this->intern_shared = false;
+  this->iterative = false;
+  this->max_depth = Options().max_depth;
+  this->stats = nullptr;
+  this->depth = 0;
+  this->stack = nullptr;
+  this->indexes = nullptr;
+  this->indexes_len = this->indexes_pos = this->indexed = 0;
+  this->top = this->size = 0;
+}
+
+Context::~Context() {
+  if (this->stack != nullptr) {
+    free(this->stack);
+    this->stack = nullptr;
+  }
+  this->top = this->size = 0;
+  std::free(this->indexes);
+  this->indexes = nullptr;
+}
+
+inline void Context::putc(char ch) {
+  if (this->top == this->size)
+    this->stack_grow();
+  this->stack[top++] = ch;
+  STATS(this, stats->stack_peak = std::max(stats->stack_peak, this->top));
+}
+
+inline char Context::popc() {
+  assert(this->stack != nullptr);
+  char ch = this->stack[top--];
+  this->size -= 1;
+  return ch;
+}
+
+void Context::push(const char *str, size_t len) {
+  this->stack_grow_size(len);
+  std::memcpy(this->stack + this->top, str, len);
+  this->top += len;
+}
+
+const char *Context::pop(size_t len) {
+  assert(this->stack != nullptr || len == 0);
+  assert(this->top >= len);
+  this->top -= len;
+  return this->stack + this->top;
+}
+
+void *Context::alloc(size_t size, size_t align) {
+  if (this->arena != nullptr)
+    return this->arena->alloc(size, align);
+  if (this->recycler != nullptr)
+    return this->recycler->alloc(size);
+  STATS(this, stats->allocations++);
+  return std::malloc(size);
+}
+
+void Context::pop_values(size_t count) {
+  Value e;
+  for (size_t i = 0; i < count; i++) {
+    std::memcpy((void *)&e, this->pop(sizeof(Value)), sizeof(Value));
+    e.release();
+  }
+}
+
+void Context::pop_members(size_t count) {
+  Member m;
+  for (size_t i = 0; i < count; i++) {
+    std::memcpy((void *)&m, this->pop(sizeof(Member)), sizeof(Member));
+    m.key.release();
+    m.value.release();
+  }
+}
+
+void Context::parse_whitespace() {
+  const char *cstr = this->json;
+  this->offset = skip_whitespace(cstr + this->offset,
+                                 cstr + this->json_len) -
+                 cstr;
+}
+
+Parse Context::parse_null(Value &v) {
+  size_t i = this->offset;
+  EXPECT(this->at(i), &i, 'n');
+  if (this->at(i++) != 'u' || this->at(i++) != 'l' ||
+      this->at(i++) != 'l')
+    return Parse::INVALID_VALUE;
+  this->offset = i;
+  v.type = Type::NIL;
+  return Parse::OK;
+}
+
+Parse Context::parse_string_raw(char **str, size_t *strlen) {
+  size_t head = this->top, len;
+  const char *cstr = this->json, *end = cstr + this->json_len;
+  int64_t i = this->offset;
+  EXPECT(this->at(i), &i, '\"');
   while (1) {
-    char ch = (*this->json)[i++];
+    /* Copy the run of plain characters in one go. */
+    const char *p = cstr + i, *q = scan_string_chars(p, end);
+    if (q != p) {
+      this->push(p, q - p);
+      i += q - p;
+    }
+    char ch = this->at(i++);
     switch (ch) {
     case '\"':
       len = this->top - head;
-      *str = (char *)std::malloc(len);
-      std::memcpy(*str, this->pop(len), len);
+      *str = (char *)this->pop(len);
       *strlen = len;
       this->offset = i;
       return Parse::OK;
     case '\\':
-      ch = (*this->json)[i++];
+      ch = this->at(i++);
       switch (ch) {
       case '\"':
         this->putc('\"');
@@ -248,7 +3477,7 @@ Parse Context::parse_string_raw(char **str, size_t *strlen) {
           return Parse::INVALID_UNICODE_HEX;
         }
         if (u >= 0xD800 && u <= 0xDBFF) {
-          if ((*this->json)[i++] != '\\' || (*this->json)[i++] != 'u') {
+          if (this->at(i++) != '\\' || this->at(i++) != 'u') {
             this->top = head;
             return Parse::INVALID_UNICODE_SURROGATE;
           }
@@ -273,100 +3502,220 @@ Parse Context::parse_string_raw(char **str, size_t *strlen) {
       this->top = head;
       return Parse::MISS_QUOTATION_MARK;
     default:
-      if ((unsigned char)ch < 0x20) {
-        this->top = head;
-        return Parse::INVALID_STRING_CHAR;
-      }
-      this->putc(ch);
+      /* scan_string_chars() only stops here on a control character */
+      this->top = head;
+      return Parse::INVALID_STRING_CHAR;
     }
   }
 }
 
-Parse Context::parse_string(Value &v) {
+Parse Context::parse_string(Value &v, bool is_key) {
+  STATS_TIMER(this, string_ns);
   size_t len;
   Parse ret;
   char *str;
+  const char *begin = this->json + this->offset + 1;
+  if (this->zero_copy) {
+    /* Plain strings only need their closing quote found. */
+    const char *end = this->json + this->json_len;
+    const char *p = scan_string_chars(begin, end);
+    if (p < end && *p == '\"' && size_t(p - begin) <= UINT32_MAX) {
+      v.type = Type::STRING;
+      v.flags = FLAG_BORROWED;
+      v.s = (char *)begin;
+      v.len = p - begin;
+      this->offset = p + 1 - this->json;
+      return Parse::OK;
+    }
+  }
   if ((ret = this->parse_string_raw(&str, &len)) != Parse::OK) {
     return ret;
   }
-  v.set_cstring(str, len);
+  /* the raw string is the longer of the two, and may be borrowed below */
+  if (size_t(this->json + this->offset - 1 - begin) > UINT32_MAX)
+    return Parse::DOCUMENT_TOO_LARGE;
+  if (this->zero_copy && this->arena == nullptr) {
+    /* Escaped strings keep their raw bytes until someone reads them. */
+    v.type = Type::STRING;
+    v.flags = FLAG_BORROWED | FLAG_ESCAPED;
+    v.s = (char *)begin;
+    v.len = this->json + this->offset - 1 - begin;
+    return Parse::OK;
+  }
+  this->set_string(v, str, len, is_key);
   return Parse::OK;
 }
 
+/* Stores decoded string bytes in `v`: interned, pooled or copied. */
+void Context::set_string(Value &v, const char *str, size_t len, bool is_key) {
+  if (this->intern != nullptr && len > Value::SSO_CAPACITY &&
+      (is_key || (this->intern_values && len <= INTERN_VALUE_MAX_SIZE))) {
+    std::string_view pooled =
+        this->intern_shared ? this->intern->intern_shared({str, len})
+                            : this->intern->intern({str, len});
+    v.type = Type::STRING;
+    v.flags = FLAG_BORROWED;
+    v.s = (char *)pooled.data();
+    v.len = pooled.size();
+    return;
+  }
+  if (this->recycler != nullptr && this->arena == nullptr &&
+      len > Value::SSO_CAPACITY) {
+    v.type = Type::STRING;
+    v.flags = FLAG_POOLED;
+    v.s = (char *)this->recycler->alloc(len);
+    std::memcpy(v.s, str, len);
+    v.len = len;
+    return;
+  }
+  STATS(this, if (len > Value::SSO_CAPACITY && this->arena == nullptr)
+                  stats->allocations++);
+  v.set_cstring(str, len, this->arena);
+}
+
+/* every power of ten a double holds exactly */
+static const double exact_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
 /*
- *  In C++, whether the function std::stold() do underflow is uncertain.
- *  So that we use the C function std::strtold().
+ * Digits are accumulated while the grammar is checked, so integers never go
+ * through floating point. Floats whose significand and power of ten are both
+ * exact in a double take Clinger's fast path, a single correctly rounded
+ * multiply or divide. Everything else goes to std::from_chars(), which is
+ * correctly rounded and, unlike strtod(), ignores the locale.
  */
 Parse Context::parse_number(Value &v) {
-  // size_t offset = static_cast<size_t>(this->offset);
-  //
-  // try {
-  //   v.n = std::stold(*this->json, &offset);
-  // } catch (const std::invalid_argument &e) {
-  //   std::fprintf(stderr, "%s", e.what());
-  //   return Parse::INVALID_VALUE;
-  // } catch (const std::out_of_range &e) {
-  //   if ((*this->json)[this->offset] != '-') {
-  //     std::fprintf(stderr, "%s", e.what());
-  //     this->offset = offset;
-  //     v.type = Type::NUMBER;
-  //     v.n = 0.0;
-  //     return Parse::NUMBER_TOO_BIG;
-  //   }
-  // }
-  //
-  // this->offset = offset;
-  // v.type = Type::NUMBER;
-  // return Parse::OK;
-
-  char *end;
-  const char *p, *cstr = (*this->json).c_str();
-  p = cstr + this->offset;
-  if (*p == '-')
+  STATS_TIMER(this, number_ns);
+  const char *p, *cstr = this->json, *end = cstr + this->json_len;
+  const char *start = cstr + this->offset;
+  auto at = [end](const char *q) { return q < end ? *q : '\0'; };
+  uint64_t mantissa = 0;
+  int64_t exponent = 0, e = 0;
+  size_t digits = 0, frac_digits = 0;
+  bool negative = false, integral = true;
+
+  p = start;
+  if (at(p) == '-') {
+    negative = true;
     p++;
-  if (*p == '0')
+  }
+  const char *int_start = p;
+  if (at(p) == '0')
     p++;
   else {
-    if (!ISDIGIT1TO9(*p))
+    if (!ISDIGIT1TO9(at(p)))
       return Parse::INVALID_VALUE;
-    for (p++; ISDIGIT(*p); p++)
-      ;
+    for (; ISDIGIT(at(p)); p++)
+      mantissa = mantissa * 10 + (*p - '0');
   }
-  if (*p == '.') {
+  size_t int_digits = p - int_start;
+  digits = int_digits;
+  if (at(p) == '.') {
+    integral = false;
     p++;
-    if (!ISDIGIT(*p))
+    if (!ISDIGIT(at(p)))
       return Parse::INVALID_VALUE;
-    for (p++; ISDIGIT(*p); p++)
-      ;
+    const char *frac_start = p;
+    for (; ISDIGIT(at(p)); p++)
+      mantissa = mantissa * 10 + (*p - '0');
+    frac_digits = p - frac_start;
+    digits += frac_digits;
   }
-  if (*p == 'e' || *p == 'E') {
+  if (at(p) == 'e' || at(p) == 'E') {
+    integral = false;
     p++;
-    if (*p == '+' || *p == '-')
-      p++;
-    if (!ISDIGIT(*p))
+    bool exp_negative = false;
+    if (at(p) == '+' || at(p) == '-')
+      exp_negative = *p++ == '-';
+    if (!ISDIGIT(at(p)))
       return Parse::INVALID_VALUE;
-    for (p++; ISDIGIT(*p); p++)
-      ;
+    for (; ISDIGIT(at(p)); p++)
+      if (e < 100000)
+        e = e * 10 + (*p - '0');
+    if (exp_negative)
+      e = -e;
+  }
+  exponent = e - (int64_t)frac_digits;
+
+  if (integral && int_digits <= 19) {
+    /* 19 digits always fit in 64 bits, so `mantissa` is exact */
+    if (!negative || mantissa == 0) {
+      if (!negative && mantissa <= (uint64_t)INT64_MAX) {
+        v.subtype = Number::NUMBER_INT64;
+        v.i = (int64_t)mantissa;
+      } else if (!negative) {
+        v.subtype = Number::NUMBER_UINT64;
+        v.u = mantissa;
+      } else {
+        /* keep the sign of -0 */
+        v.subtype = Number::NUMBER_DOUBLE;
+        v.n = -0.0;
+      }
+    } else if (mantissa <= (uint64_t)INT64_MAX + 1) {
+      v.subtype = Number::NUMBER_INT64;
+      v.i = (int64_t)(0 - mantissa);
+    } else {
+      v.subtype = Number::NUMBER_DOUBLE;
+      v.n = -(double)mantissa;
+    }
+    v.type = Type::NUMBER;
+    this->offset = p - cstr;
+    return Parse::OK;
+  }
+  if (integral && int_digits == 20 && !negative) {
+    uint64_t u;
+    auto r = std::from_chars(int_start, p, u);
+    if (r.ec == std::errc()) {
+      v.type = Type::NUMBER;
+      v.subtype = Number::NUMBER_UINT64;
+      v.u = u;
+      this->offset = p - cstr;
+      return Parse::OK;
+    }
   }
 
-  errno = 0;
-  v.n = std::strtod(cstr + this->offset, &end);
-  if (errno == ERANGE && (v.n == HUGE_VAL || v.n == -HUGE_VAL)) {
-    v.type = Type::NIL;
-    return Parse::NUMBER_TOO_BIG;
+  double d;
+  if (digits <= 19 && mantissa <= (1ULL << 53) && exponent >= -22 &&
+      exponent <= 22) {
+    d = (double)mantissa;
+    d = exponent < 0 ? d / exact_pow10[-exponent] : d * exact_pow10[exponent];
+    if (negative)
+      d = -d;
+  } else {
+    auto r = std::from_chars(start, p, d);
+    if (r.ec == std::errc::result_out_of_range) {
+      /* where the leading digit sits tells overflow from underflow */
+      int64_t magnitude = e;
+      if (*int_start != '0') {
+        magnitude += int_digits;
+      } else {
+        const char *q = int_start + 2;
+        while (q < p && *q == '0')
+          q++;
+        magnitude -= q - (int_start + 2);
+      }
+      if (magnitude > 0) {
+        v.type = Type::NIL;
+        return Parse::NUMBER_TOO_BIG;
+      }
+      d = negative ? -0.0 : 0.0;
+    }
   }
 
-  size_t offset = end - cstr;
-  this->offset = offset;
   v.type = Type::NUMBER;
+  v.subtype = Number::NUMBER_DOUBLE;
+  v.n = d;
+  this->offset = p - cstr;
   return Parse::OK;
 }
 
 Parse Context::parse_true(Value &v) {
   size_t i = this->offset;
-  EXPECT((*this->json)[i], &i, 't');
-  if ((*this->json)[i++] != 'r' || (*this->json)[i++] != 'u' ||
-      (*this->json)[i++] != 'e')
+  EXPECT(this->at(i), &i, 't');
+  if (this->at(i++) != 'r' || this->at(i++) != 'u' ||
+      this->at(i++) != 'e')
     return Parse::INVALID_VALUE;
   v.type = Type::TRUE;
   this->offset = i;
@@ -375,9 +3724,9 @@ Parse Context::parse_true(Value &v) {
 
 Parse Context::parse_false(Value &v) {
   size_t i = this->offset;
-  EXPECT((*this->json)[i], &i, 'f');
-  if ((*this->json)[i++] != 'a' || (*this->json)[i++] != 'l' ||
-      (*this->json)[i++] != 's' || (*this->json)[i++] != 'e')
+  EXPECT(this->at(i), &i, 'f');
+  if (this->at(i++) != 'a' || this->at(i++) != 'l' ||
+      this->at(i++) != 's' || this->at(i++) != 'e')
     return Parse::INVALID_VALUE;
   v.type = Type::FALSE;
   this->offset = i;
@@ -385,7 +3734,7 @@ Parse Context::parse_false(Value &v) {
 }
 
 Parse Context::parse_literal(Value &v) {
-  switch ((*this->json)[this->offset]) {
+  switch (this->at(this->offset)) {
   case 'n':
     return this->parse_null(v);
   case 't':
@@ -398,173 +3747,1013 @@ Parse Context::parse_literal(Value &v) {
 }
 
 Parse Context::parse_value(Value &v) {
-  switch ((*this->json)[this->offset]) {
-  case 'n':
-  case 't':
-  case 'f':
-    return this->parse_literal(v);
-  case '\"':
-    return this->parse_string(v);
-  case '[':
-    return this->parse_array(v);
-  case '{':
-    return this->parse_object(v);
-  default:
-    return this->parse_number(v);
-  case '\0':
+  Parse ret;
+  switch (char_classes[(unsigned char)this->at(this->offset)]) {
+  case CC_NULL:
+    ret = this->parse_null(v);
+    break;
+  case CC_TRUE:
+    ret = this->parse_true(v);
+    break;
+  case CC_FALSE:
+    ret = this->parse_false(v);
+    break;
+  case CC_STRING:
+    ret = this->parse_string(v);
+    break;
+  case CC_ARRAY:
+    ret = this->parse_array(v);
+    break;
+  case CC_OBJECT:
+    ret = this->parse_object(v);
+    break;
+  case CC_END:
     return Parse::EXPECT_VALUE;
+  default:
+    ret = this->parse_number(v);
+    break;
   }
+  STATS(this, if (ret == Parse::OK) stats->nodes[v.type]++);
+  return ret;
 }
 
-Parse Context::parse_hex4(int64_t *offset, uint32_t *u) {
-  *u = 0;
-  for (int i = 0; i < 4; i++) {
-    *u <<= 4;
-    char ch = (*this->json)[*offset + i];
-    if (ch >= '0' && ch <= '9')
-      *u |= ch - '0';
-    else if (ch >= 'A' && ch <= 'F')
-      *u |= ch - 'A' + 10;
-    else if (ch >= 'a' && ch <= 'f')
-      *u |= ch - 'a' + 10;
-    else
-      return Parse::INVALID_UNICODE_HEX;
+/*
+ * Like parse_string_raw(), but a string without escapes is returned in place
+ * in the input instead of being copied onto the stack.
+ */
+Parse Context::parse_string_view(std::string_view *str) {
+  const char *cstr = this->json, *end = cstr + this->json_len;
+  const char *p = cstr + this->offset + 1, *q = scan_string_chars(p, end);
+  if (q < end && *q == '\"') {
+    *str = std::string_view(p, q - p);
+    this->offset = q + 1 - cstr;
+    return Parse::OK;
   }
+  char *s;
+  size_t len;
+  Parse ret = this->parse_string_raw(&s, &len);
+  if (ret == Parse::OK)
+    *str = std::string_view(s, len);
+  return ret;
+}
+
+Parse Context::parse_hex4(int64_t *offset, uint32_t *u) {
+  if (this->json_len - *offset < 4 || !hex4(this->json + *offset, u))
+    return Parse::INVALID_UNICODE_HEX;
   *offset += 4;
   return Parse::OK;
 }
 
 Parse Context::parse_array(Value &v) {
+  STATS_DEPTH(this);
   int64_t i = this->offset;
   size_t size = 0;
   Parse ret;
-  EXPECT((*this->json)[i], &i, '[');
+  EXPECT(this->at(i), &i, '[');
   this->offset = i;
   this->parse_whitespace();
   i = this->offset;
   // Handle empty array
-  if ((*this->json)[i] == ']') {
+  if (this->at(i) == ']') {
     i++;
     this->offset = i;
     v.type = Type::ARRAY;
-    v.array_len = 0;
+    v.len = 0;
     v.elems = nullptr;
     return Parse::OK;
   }
   while (1) {
-    Value *e = new Value();
-    if ((ret = this->parse_value(*e)) != Parse::OK) {
-      return ret;
+    Value e;
+    if ((ret = this->parse_value(e)) != Parse::OK) {
+      break;
     }
-    i = this->offset;
-    this->stack_grow_size(sizeof(Value *));
-    std::memcpy(this->stack + this->top, &e, sizeof(Value *));
-    this->top += sizeof(Value *);
+    if (size == UINT32_MAX) {
+      ret = Parse::DOCUMENT_TOO_LARGE;
+      break;
+    }
+    // The element is moved onto the stack, so `e` must not release it.
+    this->push((const char *)&e, sizeof(Value));
+    e.type = Type::NIL;
     size++;
     this->parse_whitespace();
     i = this->offset;
-    if ((*this->json)[i] == ',') {
+    if (this->at(i) == ',') {
       i++;
       this->offset = i;
       this->parse_whitespace();
       i = this->offset;
-    } else if ((*this->json)[i] == ']') {
+    } else if (this->at(i) == ']') {
       i++;
       v.type = Type::ARRAY;
-      v.array_len = size;
-      size *= sizeof(Value *);
-      v.elems = (Value **)std::malloc(size);
-      std::memcpy(v.elems, this->pop(size), size);
+      v.flags = this->alloc_flags();
+      v.len = size;
+      size *= sizeof(Value);
+      v.elems = (Value *)this->alloc(size, alignof(Value));
+      std::memcpy((void *)v.elems, this->pop(size), size);
       this->offset = i;
       return Parse::OK;
     } else {
-      return Parse::MISS_COMMA_OR_SQUARE_BRACKET;
+      ret = Parse::MISS_COMMA_OR_SQUARE_BRACKET;
+      break;
     }
   }
 
-  return Parse::OK;
+  this->pop_values(size);
+  return ret;
 }
+
 Parse Context::parse_object(Value &v) {
+  STATS_DEPTH(this);
   Parse ret;
   size_t size = 0, i = this->offset;
-  const size_t P_MEM_SIZE = sizeof(Member *);
+  const size_t MEM_SIZE = sizeof(Member);
 
-  EXPECT((*this->json)[i], &i, '{');
+  EXPECT(this->at(i), &i, '{');
   this->offset = i;
   this->parse_whitespace();
 
-  if ((*this->json)[this->offset] == '}') {
+  if (this->at(this->offset) == '}') {
     this->offset++;
     v.type = Type::OBJECT;
     v.members = nullptr;
-    v.members_len = 0;
+    v.len = 0;
     return Parse::OK;
   }
 
   while (1) {
-    char *str = nullptr;
-    size_t strlen = 0;
-    Member *m = nullptr;
-    if ((*this->json)[this->offset] != '\"') {
-      return Parse::MISS_KEY;
+    Member m;
+    if (this->at(this->offset) != '\"') {
+      ret = Parse::MISS_KEY;
+      break;
     }
-    if ((ret = this->parse_string_raw(&str, &strlen)) != Parse::OK) {
-      return ret;
+    if ((ret = this->parse_string(m.key, true)) != Parse::OK) {
+      break;
     }
     this->parse_whitespace();
-    if ((*this->json)[this->offset] != ':') {
-      return Parse::MISS_COLON;
+    if (this->at(this->offset) != ':') {
+      ret = Parse::MISS_COLON;
+      break;
     }
     this->offset++;
     this->parse_whitespace();
-    m = new Member();
-    m->key = std::string(str, strlen);
-
-    std::free(str);
-    str = nullptr;
-    strlen = 0;
 
-    if ((ret = this->parse_value(m->value)) != Parse::OK) {
-      return ret;
+    if ((ret = this->parse_value(m.value)) != Parse::OK) {
+      break;
+    }
+    if (size == UINT32_MAX) {
+      ret = Parse::DOCUMENT_TOO_LARGE;
+      break;
     }
-    this->stack_grow_size(P_MEM_SIZE);
-    std::memcpy(this->stack + this->top, &m, P_MEM_SIZE);
-    this->top += P_MEM_SIZE;
+    // The member is moved onto the stack, so `m` must not release it.
+    this->push((const char *)&m, MEM_SIZE);
+    m.key.type = m.value.type = Type::NIL;
     size++;
     this->parse_whitespace();
-    if ((*this->json)[this->offset] == ',') {
+    if (this->at(this->offset) == ',') {
       this->offset++;
       this->parse_whitespace();
-    } else if ((*this->json)[this->offset] == '}') {
+    } else if (this->at(this->offset) == '}') {
       this->offset++;
       v.type = Type::OBJECT;
-      v.members_len = size;
-      size *= P_MEM_SIZE;
-      v.members = (Member **)std::malloc(size);
-      std::memcpy(v.members, this->pop(size), size);
+      v.flags = this->alloc_flags();
+      v.len = size;
+      size *= MEM_SIZE;
+      v.members = (Member *)this->alloc(size + member_index_size(v.len),
+                                        alignof(Member));
+      std::memcpy((void *)v.members, this->pop(size), size);
+      index_members(v);
       return Parse::OK;
     } else {
-      return Parse::MISS_COMMA_OR_CURLY_BRACKET;
+      ret = Parse::MISS_COMMA_OR_CURLY_BRACKET;
+      break;
+    }
+  }
+
+  this->pop_members(size);
+  return ret;
+}
+
+/*
+ * An array or object that is still open. It sits on the stack below its
+ * children, which are pushed as they complete just like the recursive engine
+ * pushes them, and remembers the state of the one around it.
+ */
+struct Frame {
+  /* where the enclosing frame is on the stack, SIZE_MAX at the root */
+  size_t parent;
+  uint32_t size;
+  bool object;
+};
+
+Parse Context::parse_document(Value &v, const char *json, size_t len,
+                              const Options &options) {
+  this->json = json;
+  this->json_len = len;
+  this->offset = 0;
+  this->top = 0;
+  this->depth = 0;
+  this->arena = options.arena;
+  this->recycler = options.recycler;
+  this->zero_copy = options.zero_copy;
+  this->intern = options.intern;
+  this->intern_values = options.intern_values;
+  this->intern_shared = options.threads > 1;
+  this->iterative = options.engine != ENGINE_RECURSIVE;
+  this->max_depth = options.max_depth;
+#ifdef TINYJSON_STATS
+  this->stats = options.stats;
+  size_t blocks = this->arena != nullptr && this->stats != nullptr
+                      ? this->arena->get_block_count()
+                      : 0;
+  size_t mallocs = this->recycler != nullptr && this->stats != nullptr
+                       ? this->recycler->get_malloc_count()
+                       : 0;
+#endif
+  Parse ret;
+  if (options.threads > 1) {
+    ret = this->parse_parallel(v, options.threads);
+  } else if (options.engine == ENGINE_STRUCTURAL) {
+    ret = this->parse_structural(v);
+  } else {
+    this->parse_whitespace();
+    ret = this->parse_root(v);
+  }
+  STATS(this, stats->bytes += this->offset;
+        if (this->arena != nullptr) stats->allocations +=
+        this->arena->get_block_count() - blocks;
+        else if (this->recycler != nullptr) stats->allocations +=
+        this->recycler->get_malloc_count() - mallocs);
+  return ret;
+}
+
+Parse Context::parse_root(Value &v) {
+  STATS_PARSE_TIMER(this);
+  return this->iterative ? this->parse_iterative(v) : this->parse_value(v);
+}
+
+Parse Context::parse_iterative(Value &v) {
+  size_t frame = SIZE_MAX, depth = 0;
+  uint32_t size = 0;
+  bool object = false;
+  Parse ret = Parse::OK;
+  Value e;
+  for (;;) {
+    if (object) {
+      Value k;
+      if (this->at(this->offset) != '\"') {
+        ret = Parse::MISS_KEY;
+        break;
+      }
+      if ((ret = this->parse_string(k, true)) != Parse::OK)
+        break;
+      /* the value completes the member on top of its key */
+      this->push((const char *)&k, sizeof(Value));
+      k.type = Type::NIL;
+      this->parse_whitespace();
+      if (this->at(this->offset) != ':') {
+        ret = Parse::MISS_COLON;
+        break;
+      }
+      this->offset++;
+      this->parse_whitespace();
     }
+
+    char ch = this->at(this->offset);
+    if (ch == '[' || ch == '{') {
+      if (depth == this->max_depth) {
+        ret = Parse::NESTING_TOO_DEEP;
+        break;
+      }
+      STATS(this, stats->max_depth =
+                      std::max(stats->max_depth, this->depth + depth + 1));
+      this->offset++;
+      this->parse_whitespace();
+      if (this->at(this->offset) != (ch == '[' ? ']' : '}')) {
+        Frame f = {frame, size, object};
+        this->push((const char *)&f, sizeof(Frame));
+        frame = this->top - sizeof(Frame);
+        depth++;
+        size = 0;
+        object = ch == '{';
+        continue;
+      }
+      this->offset++;
+      e.type = ch == '[' ? Type::ARRAY : Type::OBJECT;
+      e.len = 0;
+      e.elems = nullptr;
+      STATS(this, stats->nodes[e.type]++);
+    } else if ((ret = this->parse_value(e)) != Parse::OK) {
+      break;
+    }
+
+    /* `e` is complete, and may complete the frames around it in turn */
+    for (;;) {
+      if (frame == SIZE_MAX) {
+        std::memcpy((void *)&v, (const void *)&e, sizeof(Value));
+        e.type = Type::NIL;
+        return Parse::OK;
+      }
+      /* Value::len counts the elements or members in 32 bits */
+      if (size == UINT32_MAX) {
+        ret = Parse::DOCUMENT_TOO_LARGE;
+        break;
+      }
+      // The value is moved onto the stack, so `e` must not release it.
+      this->push((const char *)&e, sizeof(Value));
+      e.type = Type::NIL;
+      e.flags = 0;
+      size++;
+      this->parse_whitespace();
+      ch = this->at(this->offset);
+      if (ch == ',') {
+        this->offset++;
+        this->parse_whitespace();
+        break;
+      }
+      if (ch != (object ? '}' : ']')) {
+        ret = object ? Parse::MISS_COMMA_OR_CURLY_BRACKET
+                     : Parse::MISS_COMMA_OR_SQUARE_BRACKET;
+        break;
+      }
+      this->offset++;
+      e.flags = this->alloc_flags();
+      e.len = size;
+      if (object) {
+        size_t len = size * sizeof(Member);
+        e.type = Type::OBJECT;
+        e.members = (Member *)this->alloc(len + member_index_size(size),
+                                          alignof(Member));
+        std::memcpy((void *)e.members, this->pop(len), len);
+        index_members(e);
+      } else {
+        size_t len = size * sizeof(Value);
+        e.type = Type::ARRAY;
+        e.elems = (Value *)this->alloc(len, alignof(Value));
+        std::memcpy((void *)e.elems, this->pop(len), len);
+      }
+      STATS(this, stats->nodes[e.type]++);
+      Frame f;
+      std::memcpy(&f, this->pop(sizeof(Frame)), sizeof(Frame));
+      frame = f.parent;
+      size = f.size;
+      object = f.object;
+      depth--;
+    }
+    if (ret != Parse::OK)
+      break;
+  }
+
+  /* every value above a frame is a child of it, or half of a member */
+  while (frame != SIZE_MAX) {
+    this->pop_values((this->top - frame - sizeof(Frame)) / sizeof(Value));
+    Frame f;
+    std::memcpy(&f, this->pop(sizeof(Frame)), sizeof(Frame));
+    frame = f.parent;
   }
+  return ret;
 }
 
 void Context::encode_utf8(uint32_t u) {
-  if (u <= 0x7F)
-    this->putc(u & 0xFF);
-  else if (u <= 0x7FF) {
-    this->putc(0xC0 | (u >> 6 & 0xFF));
-    this->putc(0x80 | (u & 0x3F));
-  } else if (u <= 0xFFFF) {
-    this->putc(0xE0 | (u >> 12 & 0xFF));
-    this->putc(0x80 | (u >> 6 & 0x3F));
-    this->putc(0x80 | (u & 0x3F));
+  this->stack_grow_size(4);
+  this->top += utf8_encode(this->stack + this->top, u);
+}
+
+/************
+ * Structural engine
+ ************/
+
+/* Starts stage one over the input, see index_more(). */
+void Context::start_index() {
+  if (this->indexes == nullptr) {
+    /* a window marks at most every byte, and its last block runs over */
+    this->indexes =
+        (uint32_t *)std::malloc((INDEX_WINDOW_SIZE + 64) * sizeof(uint32_t));
+    STATS(this, stats->allocations++);
+  }
+  this->indexes_len = this->indexes_pos = this->indexed = 0;
+  this->escape_carry = this->in_string_carry = this->scalar_carry = 0;
+}
+
+/*
+ * Stage one: records the offset of every token start outside of strings,
+ * i.e. an operator, an opening quote or the first byte of a number or
+ * literal, 64 bytes at a time. The closing quote of a string is recorded
+ * too, and so is any backslash or control character inside it, so stage
+ * two knows which strings it can copy as they are.
+ *
+ * Stage two calls this once it has used up the marks, and gets the next
+ * INDEX_WINDOW_SIZE bytes' worth, or more until one is found. Returns false
+ * at the end of the input.
+ */
+bool Context::index_more() {
+  const char *cstr = this->json;
+  size_t len = this->json_len, pos = this->indexed;
+  uint64_t escape_carry = this->escape_carry;
+  uint64_t in_string_carry = this->in_string_carry;
+  uint64_t scalar_carry = this->scalar_carry;
+
+  this->indexes_len = this->indexes_pos = 0;
+  for (; pos < len; pos += 64) {
+    if (this->indexes_len != 0 && pos - this->indexed >= INDEX_WINDOW_SIZE)
+      break;
+    if (in_string_carry != 0) {
+      /* the middle of a long string: the blocks with nothing in it to mark */
+      const char *q = scan_string_chars(cstr + pos, cstr + len);
+      size_t skip = (size_t)(q - cstr - pos) & ~(size_t)63;
+      if (skip != 0) {
+        escape_carry = scalar_carry = 0;
+        pos += skip - 64;
+        continue;
+      }
+    }
+    const char *p = cstr + pos;
+    char block[64];
+    if (len - pos < 64) {
+      std::memset(block, ' ', 64);
+      std::memcpy(block, p, len - pos);
+      p = block;
+    }
+
+    uint64_t bslash, quote, ctrl, space, op;
+    classify_string_block(p, &bslash, &quote, &ctrl);
+    classify_block(p, &space, &op);
+    quote &= ~find_escaped(bslash, &escape_carry);
+    /* opening quotes and string bodies, but not closing quotes */
+    uint64_t in_string = prefix_xor(quote) ^ in_string_carry;
+    in_string_carry = (uint64_t)((int64_t)in_string >> 63);
+    uint64_t scalar = ~(op | space | quote | in_string);
+    uint64_t scalar_starts = scalar & ~((scalar << 1) | scalar_carry);
+    scalar_carry = scalar >> 63;
+    uint64_t marks = (op & ~in_string) | quote | scalar_starts |
+                     ((bslash | ctrl) & in_string);
+
+    while (marks != 0) {
+      this->indexes[this->indexes_len++] = pos + __builtin_ctzll(marks);
+      marks &= marks - 1;
+    }
+  }
+  this->indexed = std::min(pos, len);
+  this->escape_carry = escape_carry;
+  this->in_string_carry = in_string_carry;
+  this->scalar_carry = scalar_carry;
+  return this->indexes_len != 0;
+}
+
+/*
+ * A value must be followed by nothing but whitespace up to the next token,
+ * otherwise it had trailing garbage such as the `x` in `[1x]`.
+ */
+bool Context::at_next_token() {
+  this->parse_whitespace();
+  return this->has_token() &&
+         (size_t)this->offset == this->indexes[this->indexes_pos];
+}
+
+/*
+ * Parses the top-level array in slices between its elements, one thread per
+ * slice, each into its own context and arena. The elements are then moved
+ * into one block in order. Anything that is not a large array, and any
+ * error, goes to the serial parser, which also gives the exact error code.
+ */
+Parse Context::parse_parallel(Value &v, unsigned threads) {
+  const char *cstr = this->json;
+  size_t len = this->json_len;
+  this->parse_whitespace();
+  size_t start = this->offset;
+  size_t parts = std::min<size_t>(threads, (len - start) /
+                                               PARALLEL_MIN_CHUNK_SIZE);
+  if (this->at(start) != '[' || parts < 2 ||
+      (this->iterative && this->max_depth == 0))
+    return this->parse_root(v);
+
+  std::vector<size_t> bounds(parts + 1);
+  size_t nsplits;
+  size_t close = split_array(cstr, len, start, parts, &bounds[1], &nsplits);
+  if (close == len || nsplits == 0)
+    return this->parse_root(v);
+  parts = nsplits + 1;
+  bounds[0] = start;
+  bounds[parts] = close;
+
+  /* slice 0 runs here, with this context and arena */
+  std::vector<std::unique_ptr<Context>> contexts;
+  std::vector<std::unique_ptr<Arena>> arenas;
+  std::vector<size_t> counts(parts, 0);
+  std::vector<Parse> rets(parts, Parse::OK);
+  std::vector<std::thread> workers;
+#ifdef TINYJSON_STATS
+  std::vector<Stats> stats(this->stats != nullptr ? parts : 0);
+  Stats counted;
+  if (this->stats != nullptr)
+    counted = *this->stats;
+#endif
+  for (size_t k = 1; k < parts; k++) {
+    contexts.push_back(std::make_unique<Context>());
+    Context *c = contexts.back().get();
+    c->json = this->json;
+    c->json_len = this->json_len;
+    c->zero_copy = this->zero_copy;
+    c->intern = this->intern;
+    c->intern_values = this->intern_values;
+    c->intern_shared = true;
+    c->iterative = this->iterative;
+    /* the elements are one level down */
+    c->max_depth = this->max_depth - 1;
+    c->depth = this->depth + 1;
+#ifdef TINYJSON_STATS
+    c->stats = this->stats != nullptr ? &stats[k] : nullptr;
+#endif
+    if (this->arena != nullptr) {
+      arenas.push_back(std::make_unique<Arena>());
+      c->arena = arenas.back().get();
+    }
+    c->offset = bounds[k] + 1;
+    workers.emplace_back([c, &bounds, &counts, &rets, k] {
+      rets[k] = c->parse_elements(bounds[k + 1], &counts[k]);
+    });
+  }
+  this->offset = start + 1;
+  this->max_depth--;
+  this->depth++;
+  rets[0] = this->parse_elements(bounds[1], &counts[0]);
+  this->max_depth++;
+  this->depth--;
+  for (auto &worker : workers)
+    worker.join();
+
+  size_t size = 0;
+  bool ok = true;
+  for (size_t k = 0; k < parts; k++) {
+    size += counts[k];
+    ok = ok && rets[k] == Parse::OK;
+  }
+#ifdef TINYJSON_STATS
+  if (this->stats != nullptr) {
+    for (size_t k = 1; k < parts; k++) {
+      /* a failed slice is parsed again, and its values are counted then */
+      if (!ok)
+        std::memset(stats[k].nodes, 0, sizeof(stats[k].nodes));
+      this->stats->add(stats[k]);
+    }
+    if (!ok) {
+      std::memcpy(this->stats->nodes, counted.nodes, sizeof(counted.nodes));
+      for (auto &arena : arenas)
+        this->stats->allocations += arena->get_block_count();
+    }
+  }
+#endif
+  if (!ok || size > UINT32_MAX) {
+    this->pop_values(counts[0]);
+    for (size_t k = 1; k < parts; k++)
+      contexts[k - 1]->pop_values(counts[k]);
+    if (ok)
+      return Parse::DOCUMENT_TOO_LARGE;
+    this->top = 0;
+    this->offset = start;
+    return this->parse_root(v);
+  }
+
+  v.type = Type::ARRAY;
+  v.flags = this->alloc_flags();
+  v.len = size;
+  v.elems = (Value *)this->alloc(size * sizeof(Value), alignof(Value));
+  std::memcpy((void *)v.elems, this->pop(counts[0] * sizeof(Value)),
+              counts[0] * sizeof(Value));
+  Value *e = v.elems + counts[0];
+  for (size_t k = 1; k < parts; k++) {
+    size_t bytes = counts[k] * sizeof(Value);
+    std::memcpy((void *)e, contexts[k - 1]->pop(bytes), bytes);
+    e += counts[k];
+  }
+  for (auto &arena : arenas)
+    this->arena->adopt(*arena);
+  this->offset = close + 1;
+  STATS(this, stats->nodes[Type::ARRAY]++,
+        stats->max_depth = std::max(stats->max_depth, this->depth + 1));
+  return Parse::OK;
+}
+
+/*
+ * Parses the comma-separated elements from the offset up to `end`, which
+ * must be exactly where the last one is followed by a separator. They are
+ * left on the stack, `*count` of them, for the caller to move or release.
+ */
+Parse Context::parse_elements(size_t end, size_t *count) {
+  const char *cstr = this->json;
+  Parse ret;
+  while (1) {
+    Value e;
+    this->parse_whitespace();
+    if ((ret = this->parse_root(e)) != Parse::OK)
+      return ret;
+    this->push((const char *)&e, sizeof(Value));
+    e.type = Type::NIL;
+    (*count)++;
+    this->parse_whitespace();
+    if ((size_t)this->offset == end)
+      return Parse::OK;
+    if ((size_t)this->offset > end || cstr[this->offset] != ',')
+      return Parse::MISS_COMMA_OR_SQUARE_BRACKET;
+    this->offset++;
+  }
+}
+
+/*
+ * Stage two parses every scalar with the code the other engines use, at the
+ * same offsets, and checks the tokens between them in the same order, so it
+ * fails with the error they would. Input too large for 32-bit offsets goes
+ * to parse_root() instead.
+ */
+Parse Context::parse_structural(Value &v) {
+  if (this->json_len > UINT32_MAX) {
+    this->parse_whitespace();
+    return this->parse_root(v);
+  }
+  STATS_PARSE_TIMER(this);
+  this->start_index();
+  return this->parse_indexed_value(v);
+}
+
+Parse Context::parse_indexed_value(Value &v) {
+  if (!this->has_token())
+    return Parse::EXPECT_VALUE;
+  this->offset = this->indexes[this->indexes_pos++];
+  Parse ret;
+  switch (char_classes[(unsigned char)this->at(this->offset)]) {
+  case CC_ARRAY:
+  case CC_OBJECT:
+    /* one level of recursion each, so the stack is bounded by max_depth */
+    if (this->max_depth == 0)
+      return Parse::NESTING_TOO_DEEP;
+    this->max_depth--;
+    ret = this->at(this->offset) == '[' ? this->parse_indexed_array(v)
+                                        : this->parse_indexed_object(v);
+    this->max_depth++;
+    break;
+  case CC_STRING:
+    ret = this->parse_indexed_string(v, false);
+    break;
+  default:
+    return this->parse_value(v);
+  }
+  STATS(this, if (ret == Parse::OK) stats->nodes[v.type]++);
+  return ret;
+}
+
+/*
+ * Right after an opening quote, the next mark is the closing quote if the
+ * string holds no backslash or control character. Such a string is taken
+ * from between the two as it is, any other through parse_string(), which
+ * also finds its error; the marks inside it are skipped.
+ */
+Parse Context::parse_indexed_string(Value &v, bool is_key) {
+  size_t open = this->offset;
+  if (this->has_token() &&
+      this->json[this->indexes[this->indexes_pos]] == '\"') {
+    STATS_TIMER(this, string_ns);
+    size_t close = this->indexes[this->indexes_pos++];
+    const char *begin = this->json + open + 1;
+    this->offset = close + 1;
+    if (this->zero_copy) {
+      v.type = Type::STRING;
+      v.flags = FLAG_BORROWED;
+      v.s = (char *)begin;
+      v.len = close - open - 1;
+    } else {
+      this->set_string(v, begin, close - open - 1, is_key);
+    }
+    return Parse::OK;
+  }
+  Parse ret = this->parse_string(v, is_key);
+  while (this->has_token() &&
+         this->indexes[this->indexes_pos] < (size_t)this->offset)
+    this->indexes_pos++;
+  return ret;
+}
+
+Parse Context::parse_indexed_array(Value &v) {
+  STATS_DEPTH(this);
+  const char *cstr = this->json;
+  size_t size = 0;
+  Parse ret;
+  if (this->has_token() && cstr[this->indexes[this->indexes_pos]] == ']') {
+    this->offset = this->indexes[this->indexes_pos++] + 1;
+    v.type = Type::ARRAY;
+    v.len = 0;
+    v.elems = nullptr;
+    return Parse::OK;
+  }
+  while (1) {
+    Value e;
+    if ((ret = this->parse_indexed_value(e)) != Parse::OK) {
+      break;
+    }
+    this->push((const char *)&e, sizeof(Value));
+    e.type = Type::NIL;
+    size++;
+    if (!this->at_next_token()) {
+      ret = Parse::MISS_COMMA_OR_SQUARE_BRACKET;
+      break;
+    }
+    uint32_t i = this->indexes[this->indexes_pos++];
+    if (cstr[i] == ',') {
+      continue;
+    } else if (cstr[i] == ']') {
+      this->offset = i + 1;
+      v.type = Type::ARRAY;
+      v.flags = this->alloc_flags();
+      v.len = size;
+      size *= sizeof(Value);
+      v.elems = (Value *)this->alloc(size, alignof(Value));
+      std::memcpy((void *)v.elems, this->pop(size), size);
+      return Parse::OK;
+    } else {
+      ret = Parse::MISS_COMMA_OR_SQUARE_BRACKET;
+      break;
+    }
+  }
+
+  this->pop_values(size);
+  return ret;
+}
+
+Parse Context::parse_indexed_object(Value &v) {
+  STATS_DEPTH(this);
+  const char *cstr = this->json;
+  size_t size = 0;
+  Parse ret;
+  if (this->has_token() && cstr[this->indexes[this->indexes_pos]] == '}') {
+    this->offset = this->indexes[this->indexes_pos++] + 1;
+    v.type = Type::OBJECT;
+    v.len = 0;
+    v.members = nullptr;
+    return Parse::OK;
+  }
+  while (1) {
+    Member m;
+    if (!this->has_token()) {
+      ret = Parse::MISS_KEY;
+      break;
+    }
+    this->offset = this->indexes[this->indexes_pos++];
+    if (cstr[this->offset] != '\"') {
+      ret = Parse::MISS_KEY;
+      break;
+    }
+    if ((ret = this->parse_indexed_string(m.key, true)) != Parse::OK) {
+      break;
+    }
+    if (!this->at_next_token() ||
+        cstr[this->indexes[this->indexes_pos++]] != ':') {
+      ret = Parse::MISS_COLON;
+      break;
+    }
+    if ((ret = this->parse_indexed_value(m.value)) != Parse::OK) {
+      break;
+    }
+    this->push((const char *)&m, sizeof(Member));
+    m.key.type = m.value.type = Type::NIL;
+    size++;
+    if (!this->at_next_token()) {
+      ret = Parse::MISS_COMMA_OR_CURLY_BRACKET;
+      break;
+    }
+    uint32_t i = this->indexes[this->indexes_pos++];
+    if (cstr[i] == ',') {
+      continue;
+    } else if (cstr[i] == '}') {
+      this->offset = i + 1;
+      v.type = Type::OBJECT;
+      v.flags = this->alloc_flags();
+      v.len = size;
+      size *= sizeof(Member);
+      v.members = (Member *)this->alloc(size + member_index_size(v.len),
+                                        alignof(Member));
+      std::memcpy((void *)v.members, this->pop(size), size);
+      index_members(v);
+      return Parse::OK;
+    } else {
+      ret = Parse::MISS_COMMA_OR_CURLY_BRACKET;
+      break;
+    }
+  }
+
+  this->pop_members(size);
+  return ret;
+}
+
+const char *Context::stringify(Value &v, size_t *len) {
+  this->top = 0;
+  this->stringify_value(v);
+  *len = this->top;
+  return this->stack;
+}
+
+void Context::stringify_value(Value &v) {
+  switch (v.type) {
+  case Type::NIL:
+    this->push("null", 4);
+    break;
+  case Type::FALSE:
+    this->push("false", 5);
+    break;
+  case Type::TRUE:
+    this->push("true", 4);
+    break;
+  case Type::NUMBER:
+    this->stringify_number(v);
+    break;
+  case Type::STRING:
+    if (v.flags & FLAG_ESCAPED) {
+      /* still the escaped bytes of the input, which are valid as they are */
+      this->putc('\"');
+      this->push(v.s, v.len);
+      this->putc('\"');
+    } else {
+      this->stringify_string(v.get_string_data(), v.get_string_len());
+    }
+    break;
+  case Type::ARRAY:
+    this->putc('[');
+    for (size_t i = 0; i < v.len; i++) {
+      if (i > 0)
+        this->putc(',');
+      this->stringify_value(v.elems[i]);
+    }
+    this->putc(']');
+    break;
+  case Type::OBJECT:
+    this->putc('{');
+    for (size_t i = 0; i < v.len; i++) {
+      if (i > 0)
+        this->putc(',');
+      this->stringify_value(v.members[i].key);
+      this->putc(':');
+      this->stringify_value(v.members[i].value);
+    }
+    this->putc('}');
+    break;
+  }
+}
+
+void Context::stringify_string(const char *str, size_t len) {
+  static const char hex_digits[] = "0123456789ABCDEF";
+  const char *p = str, *end = str + len;
+  /* the worst case is six bytes per input byte, reserve for the common one */
+  this->stack_grow_size(len + 2);
+  this->stack[this->top++] = '\"';
+  for (;;) {
+    const char *q = scan_string_chars(p, end);
+    this->push(p, q - p);
+    if (q == end)
+      break;
+    char e = escapes[(unsigned char)*q];
+    if (e == 'u') {
+      char buf[6] = {'\\', 'u', '0', '0', hex_digits[(unsigned char)*q >> 4],
+                     hex_digits[*q & 0xF]};
+      this->push(buf, 6);
+    } else {
+      char buf[2] = {'\\', e};
+      this->push(buf, 2);
+    }
+    p = q + 1;
+  }
+  this->putc('\"');
+}
+
+void Context::stringify_number(Value &v) {
+  /* 24 bytes hold any shortest double and any 64-bit integer */
+  this->stack_grow_size(24);
+  char *out = this->stack + this->top;
+  std::to_chars_result r;
+  if (v.subtype == Number::NUMBER_INT64) {
+    r = std::to_chars(out, out + 24, v.i);
+  } else if (v.subtype == Number::NUMBER_UINT64) {
+    r = std::to_chars(out, out + 24, v.u);
+  } else if (std::isfinite(v.n)) {
+    /* the shortest digits that read back as the same double */
+    r = std::to_chars(out, out + 24, v.n);
   } else {
-    assert(u <= 0x10FFFF);
-    this->putc(0xF0 | (u >> 18 & 0xFF));
-    this->putc(0x80 | (u >> 12 & 0x3F));
-    this->putc(0x80 | (u >> 6 & 0x3F));
-    this->putc(0x80 | (u & 0x3F));
+    /* JSON has no infinities or NaN */
+    this->push("null", 4);
+    return;
+  }
+  this->top = r.ptr - this->stack;
+}
+
+const char *Context::stringify(const BinaryValue &v, size_t *len) {
+  this->top = 0;
+  this->stringify_binary(v);
+  *len = this->top;
+  return this->stack;
+}
+
+void Context::stringify_binary(const BinaryValue &v) {
+  switch (v.get_type()) {
+  case Type::NIL:
+    this->push("null", 4);
+    break;
+  case Type::FALSE:
+    this->push("false", 5);
+    break;
+  case Type::TRUE:
+    this->push("true", 4);
+    break;
+  case Type::NUMBER: {
+    Value n;
+    if (v.get_number_type() == Number::NUMBER_INT64)
+      n.set_int64(v.get_int64());
+    else if (v.get_number_type() == Number::NUMBER_UINT64)
+      n.set_uint64(v.get_uint64());
+    else
+      n.set_number(v.get_number());
+    this->stringify_number(n);
+    break;
+  }
+  case Type::STRING: {
+    std::string_view str = v.get_string_view();
+    this->stringify_string(str.data(), str.size());
+    break;
+  }
+  case Type::ARRAY:
+    this->putc('[');
+    for (size_t i = 0; i < v.get_array_size(); i++) {
+      if (i > 0)
+        this->putc(',');
+      this->stringify_binary(v.get_array_elem(i));
+    }
+    this->putc(']');
+    break;
+  case Type::OBJECT:
+    this->putc('{');
+    for (size_t i = 0; i < v.get_object_size(); i++) {
+      if (i > 0)
+        this->putc(',');
+      std::string_view key = v.get_object_key_view(i);
+      this->stringify_string(key.data(), key.size());
+      this->putc(':');
+      this->stringify_binary(v.get_object_value(i));
+    }
+    this->putc('}');
+    break;
+  }
+}
+
+const char *Context::stringify(const TapeValue &v, size_t *len) {
+  this->top = 0;
+  this->stringify_tape(v);
+  *len = this->top;
+  return this->stack;
+}
+
+void Context::stringify_tape(const TapeValue &v) {
+  switch (v.get_type()) {
+  case Type::NIL:
+    this->push("null", 4);
+    break;
+  case Type::FALSE:
+    this->push("false", 5);
+    break;
+  case Type::TRUE:
+    this->push("true", 4);
+    break;
+  case Type::NUMBER: {
+    Value n;
+    if (v.get_number_type() == Number::NUMBER_INT64)
+      n.set_int64(v.get_int64());
+    else if (v.get_number_type() == Number::NUMBER_UINT64)
+      n.set_uint64(v.get_uint64());
+    else
+      n.set_number(v.get_number());
+    this->stringify_number(n);
+    break;
+  }
+  case Type::STRING: {
+    std::string_view str = v.get_string_view();
+    this->stringify_string(str.data(), str.size());
+    break;
+  }
+  case Type::ARRAY:
+    this->putc('[');
+    for (TapeIterator it = v.begin(); it != v.end(); ++it) {
+      if (it != v.begin())
+        this->putc(',');
+      this->stringify_tape(*it);
+    }
+    this->putc(']');
+    break;
+  case Type::OBJECT:
+    this->putc('{');
+    for (TapeIterator it = v.begin(); it != v.end(); ++it) {
+      if (it != v.begin())
+        this->putc(',');
+      std::string_view key = it.key();
+      this->stringify_string(key.data(), key.size());
+      this->putc(':');
+      this->stringify_tape(*it);
+    }
+    this->putc('}');
+    break;
   }
 }
 
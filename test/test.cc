@@ -1,8 +1,12 @@
 #include "tinyjson.hh"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <vector>
 
 static int main_ret = 0;
 static int test_count = 0;
@@ -38,6 +42,14 @@ static int test_pass = 0;
                      !std::memcmp(expect, actual, length),                     \
                  expect, actual, "%s")
 
+#define EXPECT_EQ_INT64(expect, actual)                                        \
+  EXPECT_EQ_BASE((expect) == (actual), (long long)(expect),                    \
+                 (long long)(actual), "%lld")
+
+#define EXPECT_EQ_UINT64(expect, actual)                                       \
+  EXPECT_EQ_BASE((expect) == (actual), (unsigned long long)(expect),           \
+                 (unsigned long long)(actual), "%llu")
+
 #ifdef _MSC_VER
 #define EXPECT_EQ_SIZE_T(expect, actual)                                       \
   EXPECT_EQ_BASE((expect) == (actual), (size_t)expect, (size_t)actual, "%lu")
@@ -46,6 +58,40 @@ static int test_pass = 0;
   EXPECT_EQ_BASE((expect) == (actual), (size_t)expect, (size_t)actual, "%zu")
 #endif
 
+/* The structural engine must agree with the recursive one on everything. */
+static void check_structural(const std::string &json) {
+  auto s = std::make_shared<std::string>(json);
+  tinyjson::Value expect, actual, borrowed;
+  tinyjson::Options options;
+  options.engine = tinyjson::ENGINE_STRUCTURAL;
+  tinyjson::Parse ret = expect.parse(s);
+  EXPECT_EQ_INT(ret, actual.parse(s, options));
+  EXPECT_TRUE(expect.is_equal(actual));
+  options.zero_copy = true;
+  EXPECT_EQ_INT(ret, borrowed.parse(s, options));
+  EXPECT_TRUE(expect.is_equal(borrowed));
+}
+
+/*
+ * A buffer of exactly the input's size has no terminator to stop at, so a
+ * read past the end shows up under AddressSanitizer.
+ */
+static void check_unterminated(const std::string &json) {
+  tinyjson::Value expect;
+  tinyjson::Parse ret = expect.parse(std::make_shared<std::string>(json));
+  std::unique_ptr<char[]> buf(new char[json.size()]);
+  std::memcpy(buf.get(), json.data(), json.size());
+  tinyjson::Options options;
+  for (int mode = 0; mode < 3; mode++) {
+    options.engine = mode == 1 ? tinyjson::ENGINE_STRUCTURAL
+                               : tinyjson::ENGINE_RECURSIVE;
+    options.zero_copy = mode == 2;
+    tinyjson::Value actual;
+    EXPECT_EQ_INT(ret, actual.parse(buf.get(), json.size(), options));
+    EXPECT_TRUE(expect.is_equal(actual));
+  }
+}
+
 #define TEST_ERROR(error, json)                                                \
   do {                                                                         \
     tinyjson::Value v;                                                         \
@@ -53,6 +99,8 @@ static int test_pass = 0;
     EXPECT_EQ_INT(error,                                                       \
                   v.parse(std::make_shared<std::string>(std::string(json))));  \
     EXPECT_EQ_INT(tinyjson::Type::NIL, v.get_type());                          \
+    check_structural(json);                                                    \
+    check_unterminated(json);                                                  \
   } while (0)
 
 #define TEST_NUMBER(expect, json)                                              \
@@ -62,6 +110,8 @@ static int test_pass = 0;
                   v.parse(std::make_shared<std::string>(std::string(json))));  \
     EXPECT_EQ_INT(tinyjson::Type::NUMBER, v.get_type());                       \
     EXPECT_EQ_DOUBLE(expect, v.get_number());                                  \
+    check_structural(json);                                                    \
+    check_unterminated(json);                                                  \
   } while (0)
 
 #define TEST_STRING(expect, json)                                              \
@@ -71,6 +121,8 @@ static int test_pass = 0;
                   v.parse(std::make_shared<std::string>(std::string(json))));  \
     EXPECT_EQ_INT(tinyjson::Type::STRING, v.get_type());                       \
     EXPECT_EQ_STRING(expect, v.get_string().c_str(), v.get_string().length()); \
+    check_structural(json);                                                    \
+    check_unterminated(json);                                                  \
   } while (0)
 
 #define TEST_ARRAY(expect, expect_size, json)                                  \
@@ -80,6 +132,8 @@ static int test_pass = 0;
                   v.parse(std::make_shared<std::string>(std::string(json))));  \
     EXPECT_EQ_INT(tinyjson::Type::ARRAY, v.get_type());                        \
     EXPECT_EQ_SIZE_T(expect_size, v.get_array_size());                         \
+    check_structural(json);                                                    \
+    check_unterminated(json);                                                  \
   } while (0)
 
 #define TEST_GETTER_STRING(expect, json) TEST_STRING(expect, json)
@@ -154,9 +208,77 @@ static void test_parse_number() {
   TEST_NUMBER(-1.7976931348623157e+308, "-1.7976931348623157e+308");
 }
 
+#define TEST_INT64(expect, json)                                               \
+  do {                                                                         \
+    tinyjson::Value v;                                                         \
+    EXPECT_EQ_INT(tinyjson::Parse::OK,                                         \
+                  v.parse(std::make_shared<std::string>(std::string(json))));  \
+    EXPECT_EQ_INT(tinyjson::Number::NUMBER_INT64, v.get_number_type());        \
+    EXPECT_EQ_INT64(expect, v.get_int64());                                    \
+    check_structural(json);                                                    \
+    check_unterminated(json);                                                  \
+  } while (0)
+
+#define TEST_UINT64(expect, json)                                              \
+  do {                                                                         \
+    tinyjson::Value v;                                                         \
+    EXPECT_EQ_INT(tinyjson::Parse::OK,                                         \
+                  v.parse(std::make_shared<std::string>(std::string(json))));  \
+    EXPECT_EQ_INT(tinyjson::Number::NUMBER_UINT64, v.get_number_type());       \
+    EXPECT_EQ_UINT64(expect, v.get_uint64());                                  \
+    check_structural(json);                                                    \
+    check_unterminated(json);                                                  \
+  } while (0)
+
+static void test_parse_integer() {
+  TEST_INT64(0, "0");
+  TEST_INT64(42, "42");
+  TEST_INT64(-42, "-42");
+  TEST_INT64(9007199254740993LL, "9007199254740993"); /* 2^53 + 1 */
+  TEST_INT64(INT64_MAX, "9223372036854775807");
+  TEST_INT64(INT64_MIN, "-9223372036854775808");
+  TEST_UINT64(9223372036854775808ULL, "9223372036854775808");
+  TEST_UINT64(UINT64_MAX, "18446744073709551615");
+
+  /* past the integer types, or not integral: stored as double */
+  TEST_NUMBER(18446744073709551616.0, "18446744073709551616");
+  TEST_NUMBER(-9223372036854775809.0, "-9223372036854775809");
+  TEST_NUMBER(9007199254740992.0, "9007199254740993.0");
+  TEST_NUMBER(100.0, "1e2");
+
+  /* -0 keeps its sign, so it has to be a double */
+  tinyjson::Value v;
+  v.parse(std::make_shared<std::string>("-0"));
+  EXPECT_EQ_INT(tinyjson::Number::NUMBER_DOUBLE, v.get_number_type());
+  EXPECT_TRUE(std::signbit(v.get_number()));
+
+  /* integers still read as numbers */
+  v.parse(std::make_shared<std::string>("-9223372036854775808"));
+  EXPECT_EQ_DOUBLE(-9223372036854775808.0, v.get_number());
+  v.parse(std::make_shared<std::string>("18446744073709551615"));
+  EXPECT_EQ_DOUBLE(18446744073709551615.0, v.get_number());
+}
+
+static void test_parse_number_hard() {
+  TEST_NUMBER(0.1, "0.1");
+  TEST_NUMBER(0.3, "0.3");
+  TEST_NUMBER(2.2250738585072011e-308, "2.2250738585072011e-308");
+  TEST_NUMBER(2.2250738585072012e-308, "2.2250738585072012e-308");
+  TEST_NUMBER(1.7976931348623158e+308, "1.7976931348623158e+308");
+  TEST_NUMBER(9007199254740994.0, "9007199254740993.00000000000000000001");
+  TEST_NUMBER(123456789012345678901234567890.0,
+              "123456789012345678901234567890");
+  TEST_NUMBER(0.0, "0.0000000000000000000000000000000000000001e-400");
+  TEST_NUMBER(1e22, "1e22");
+  TEST_NUMBER(1e23, "1e23");
+  TEST_NUMBER(8.41e21, "8.41e21");
+  TEST_NUMBER(5e-324, "5e-324");
+}
+
 static void test_parse_number_too_big() {
   TEST_ERROR(tinyjson::Parse::NUMBER_TOO_BIG, "1e309");
   TEST_ERROR(tinyjson::Parse::NUMBER_TOO_BIG, "-1e309");
+  TEST_ERROR(tinyjson::Parse::NUMBER_TOO_BIG, "0.00001e400");
 }
 
 static void test_parse_invalid_value() {
@@ -359,10 +481,1647 @@ static void test_parse_object() {
   }
 }
 
+static void test_parse_arena() {
+  tinyjson::Document doc;
+  EXPECT_EQ_INT(tinyjson::Parse::OK,
+                doc.parse(std::make_shared<std::string>(
+                    "{ \"a\" : [ 1, \"abc\", { \"b\" : null } ], "
+                    "\"s\" : \"hello, world\\n\" }")));
+  EXPECT_TRUE(doc.arena.get_block_count() > 0);
+  tinyjson::Value &v = doc.root;
+  EXPECT_EQ_INT(tinyjson::Type::OBJECT, v.get_type());
+  EXPECT_EQ_SIZE_T(2, v.get_object_size());
+  EXPECT_EQ_STRING("a", v.get_object_key(0).c_str(), v.get_object_key_len(0));
+  tinyjson::Value *a = v.get_object_value(0);
+  EXPECT_EQ_INT(tinyjson::Type::ARRAY, a->get_type());
+  EXPECT_EQ_SIZE_T(3, a->get_array_size());
+  EXPECT_EQ_DOUBLE(1.0, a->get_array_elem(0)->get_number());
+  EXPECT_EQ_STRING("abc", a->get_array_elem(1)->get_string().c_str(),
+                   a->get_array_elem(1)->get_string_len());
+  EXPECT_EQ_INT(tinyjson::Type::OBJECT, a->get_array_elem(2)->get_type());
+  EXPECT_EQ_STRING("s", v.get_object_key(1).c_str(), v.get_object_key_len(1));
+  EXPECT_EQ_STRING("hello, world\n",
+                   v.get_object_value(1)->get_string().c_str(),
+                   v.get_object_value(1)->get_string_len());
+
+  /* reparsing reuses nothing from the previous tree */
+  EXPECT_EQ_INT(tinyjson::Parse::OK,
+                doc.parse(std::make_shared<std::string>("[ true ]")));
+  EXPECT_EQ_INT(tinyjson::Type::ARRAY, doc.root.get_type());
+  EXPECT_EQ_INT(tinyjson::Type::TRUE, doc.root.get_array_elem(0)->get_type());
+
+  tinyjson::Arena arena;
+  tinyjson::Value s;
+  EXPECT_EQ_INT(tinyjson::Parse::OK,
+                s.parse(std::make_shared<std::string>("\"abcdefghijklmn\""),
+                        arena));
+  EXPECT_EQ_STRING("abcdefghijklmn", s.get_string().c_str(),
+                   s.get_string_len());
+  EXPECT_EQ_SIZE_T(1, arena.get_block_count());
+}
+
+static void test_compact_value() {
+  EXPECT_EQ_SIZE_T(16, sizeof(tinyjson::Value));
+  EXPECT_EQ_SIZE_T(32, sizeof(tinyjson::Member));
+
+  /* the longest inline string and the shortest out-of-line one */
+  TEST_STRING("abcdefghijkl", "\"abcdefghijkl\"");
+  TEST_STRING("abcdefghijklm", "\"abcdefghijklm\"");
+  TEST_STRING("", "\"\"");
+
+  tinyjson::Value v;
+  v.set_cstring("abcdefghijkl", 12);
+  EXPECT_EQ_STRING("abcdefghijkl", v.get_string_data(), v.get_string_len());
+  v.set_cstring("hello, tinyjson", 15);
+  EXPECT_EQ_STRING("hello, tinyjson", v.get_string_data(), v.get_string_len());
+  v.set_number(1.5);
+  EXPECT_EQ_DOUBLE(1.5, v.get_number());
+  v.set_boolean(true);
+  EXPECT_EQ_INT(tinyjson::Type::TRUE, v.get_type());
+}
+
+static void test_parse_zero_copy() {
+  auto json = std::make_shared<std::string>(
+      "{ \"plain\" : \"hello, tinyjson\", "
+      "\"esc\\u0061ped\" : \"hello, world\\n\\uD834\\uDD1E\" }");
+  tinyjson::Options options;
+  options.zero_copy = true;
+  tinyjson::Value v;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse(json, options));
+  EXPECT_EQ_INT(tinyjson::Type::OBJECT, v.get_type());
+  EXPECT_EQ_SIZE_T(2, v.get_object_size());
+
+  /* plain strings point straight into the input */
+  tinyjson::Value *plain = v.get_object_value(0);
+  EXPECT_TRUE(plain->get_string_data() >= json->c_str() &&
+              plain->get_string_data() < json->c_str() + json->size());
+  EXPECT_TRUE(v.get_object_key_view(0) == "plain");
+  EXPECT_TRUE(plain->get_string_view() == "hello, tinyjson");
+
+  /* escaped ones are decoded on first access */
+  tinyjson::Value *esc = v.get_object_value(1);
+  EXPECT_TRUE(esc->flags & tinyjson::FLAG_ESCAPED);
+  EXPECT_TRUE(esc->get_string_view() == "hello, world\n\xF0\x9D\x84\x9E");
+  EXPECT_TRUE(!(esc->flags & tinyjson::FLAG_ESCAPED));
+  EXPECT_EQ_SIZE_T(17, esc->get_string_len());
+  EXPECT_EQ_SIZE_T(7, v.get_object_key_len(1));
+  EXPECT_TRUE(v.get_object_key_view(1) == "escaped");
+
+  /* errors are the same as for the copying parser */
+  TEST_ERROR(tinyjson::Parse::MISS_QUOTATION_MARK, "\"abc");
+
+  /* an arena decodes escapes right away, so nothing is left on the heap */
+  tinyjson::Document doc;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, doc.parse(json, options));
+  EXPECT_TRUE(!(doc.root.get_object_value(1)->flags & tinyjson::FLAG_ESCAPED));
+  EXPECT_TRUE(doc.root.get_object_value(1)->get_string_view() ==
+              "hello, world\n\xF0\x9D\x84\x9E");
+  EXPECT_TRUE(doc.root.get_object_value(0)->get_string_data() >=
+                  json->c_str() &&
+              doc.root.get_object_value(0)->get_string_data() <
+                  json->c_str() + json->size());
+}
+
+static void test_parse_long_string() {
+  /* put the special character at every offset of a vector block */
+  for (size_t n = 0; n < 70; n++) {
+    std::string body(n, 'a');
+    tinyjson::Value v;
+    EXPECT_EQ_INT(tinyjson::Parse::OK,
+                  v.parse(std::make_shared<std::string>(
+                      "\"" + body + "\\t" + body + "\"")));
+    EXPECT_EQ_SIZE_T(2 * n + 1, v.get_string_len());
+    EXPECT_TRUE(v.get_string() == body + "\t" + body);
+
+    TEST_ERROR(tinyjson::Parse::INVALID_STRING_CHAR,
+               "\"" + body + "\x01" + body + "\"");
+    TEST_ERROR(tinyjson::Parse::MISS_QUOTATION_MARK, "\"" + body);
+  }
+}
+
+static void test_parse_whitespace() {
+  /* runs of indentation of every length around a vector block */
+  for (size_t n = 0; n < 40; n++) {
+    std::string ws;
+    for (size_t i = 0; i < n; i++)
+      ws += " \t\r\n"[i % 4];
+    tinyjson::Value v;
+    EXPECT_EQ_INT(tinyjson::Parse::OK,
+                  v.parse(std::make_shared<std::string>(
+                      ws + "[" + ws + "1" + ws + "," + ws + "{" + ws +
+                      "\"a\"" + ws + ":" + ws + "true" + ws + "}" + ws + "]" +
+                      ws)));
+    EXPECT_EQ_INT(tinyjson::Type::ARRAY, v.get_type());
+    EXPECT_EQ_SIZE_T(2, v.get_array_size());
+    EXPECT_EQ_INT(tinyjson::Type::TRUE,
+                  v.get_array_elem(1)->get_object_value(0)->get_type());
+    TEST_ERROR(tinyjson::Parse::EXPECT_VALUE, ws);
+    TEST_ERROR(tinyjson::Parse::MISS_COMMA_OR_SQUARE_BRACKET,
+               "[1" + ws + "x]");
+  }
+}
+
+/* A small deterministic generator, so failures reproduce everywhere. */
+static uint32_t rand_state = 12345;
+
+static uint32_t next_rand() {
+  rand_state = rand_state * 1103515245 + 12345;
+  return (rand_state >> 16) & 0x7FFF;
+}
+
+static std::string random_json(int depth) {
+  static const char *scalars[] = {
+      "null", "true", "false", "0", "-12.5e3", "123456789",
+      "\"\"", "\"[{,:}]\"", "\"a\\\"b\"", "\"\\\\\"",
+      "\"\\\\\\\"]\"", "\"\\u4e2d\\uD834\\uDD1E\"",
+      "\"a fairly long string that crosses a 64-byte block boundary\"",
+  };
+  static const char *spaces[] = {"", " ", "\n  ", "\t"};
+  std::string ws = spaces[next_rand() % 4];
+  if (depth == 0 || next_rand() % 3 == 0)
+    return ws + scalars[next_rand() % (sizeof(scalars) / sizeof(*scalars))];
+  int n = next_rand() % 5;
+  bool object = next_rand() % 2;
+  std::string json = ws + (object ? "{" : "[");
+  for (int i = 0; i < n; i++) {
+    if (i != 0)
+      json += ",";
+    if (object)
+      json += ws + "\"k" + std::to_string(i) + "\\\\\"" + ws + ":";
+    json += random_json(depth - 1) + ws;
+  }
+  return json + (object ? "}" : "]");
+}
+
+static void test_parse_structural() {
+  for (int i = 0; i < 300; i++) {
+    std::string json = random_json(5);
+    check_structural(json);
+    /* damage one byte to compare the error paths as well */
+    std::string broken = json;
+    if (!broken.empty())
+      broken[next_rand() % broken.size()] = "[]{}\",:\\ x1"[next_rand() % 12];
+    check_structural(broken);
+    std::string cut = json.substr(0, next_rand() % (json.size() + 1));
+    check_structural(cut);
+    check_unterminated(cut);
+  }
+
+  /* strings across 64-byte blocks, copied as they are or decoded */
+  std::string plain(150, 'a'), escaped = plain + "\\n" + plain;
+  check_structural("[\"" + plain + "\",{\"" + escaped + "\":\"\"}]");
+  check_structural("{\"" + plain + "\":\"" + escaped + "\",\"k\":[]}");
+  check_structural("[\"" + plain + "\x01" + plain + "\"]");
+  check_structural("[\"" + plain + "\\\"\",1]");
+  check_structural("[\"" + plain);
+
+  /* stage two recurses, so it is cut off at max_depth */
+  tinyjson::Options options;
+  options.engine = tinyjson::ENGINE_STRUCTURAL;
+  options.max_depth = 3;
+  tinyjson::Value v;
+  EXPECT_EQ_INT(tinyjson::Parse::OK,
+                v.parse(std::make_shared<std::string>("[{\"k\":[]}]"),
+                        options));
+  EXPECT_EQ_INT(tinyjson::Parse::NESTING_TOO_DEEP,
+                v.parse(std::make_shared<std::string>("[{\"k\":[{}]}]"),
+                        options));
+  EXPECT_EQ_INT(tinyjson::Type::NIL, v.get_type());
+  options.max_depth = tinyjson::Options().max_depth;
+  EXPECT_EQ_INT(tinyjson::Parse::NESTING_TOO_DEEP,
+                v.parse(std::make_shared<std::string>(2000000, '['), options));
+}
+
+/* The iterative engine must agree with the recursive one on everything. */
+static void check_iterative(const std::string &json) {
+  auto s = std::make_shared<std::string>(json);
+  tinyjson::Value expect, actual;
+  tinyjson::Options recursive, iterative;
+  recursive.engine = tinyjson::ENGINE_RECURSIVE;
+  iterative.engine = tinyjson::ENGINE_ITERATIVE;
+  EXPECT_EQ_INT(expect.parse(s, recursive), actual.parse(s, iterative));
+  EXPECT_TRUE(expect.is_equal(actual));
+}
+
+static std::string nested(size_t depth, const char *inner = "1") {
+  std::string json;
+  for (size_t d = 0; d < depth; d++)
+    json += d % 2 == 0 ? "[" : "{\"k\":";
+  json += inner;
+  for (size_t d = depth; d > 0; d--)
+    json += (d - 1) % 2 == 0 ? "]" : "}";
+  return json;
+}
+
+static void test_parse_iterative() {
+  for (int i = 0; i < 300; i++) {
+    std::string json = random_json(5);
+    check_iterative(json);
+    std::string broken = json;
+    if (!broken.empty())
+      broken[next_rand() % broken.size()] = "[]{}\",:\\ x1"[next_rand() % 12];
+    check_iterative(broken);
+    check_iterative(json.substr(0, next_rand() % (json.size() + 1)));
+  }
+
+  /* far deeper than a small thread stack could recurse */
+  tinyjson::Arena arena;
+  tinyjson::Options options;
+  options.arena = &arena;
+  options.max_depth = 1000000;
+  tinyjson::Value v;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse(nested(200000), options));
+  tinyjson::Value *e = &v;
+  for (size_t d = 0; d < 200000; d++)
+    e = d % 2 == 0 ? e->get_array_elem(0) : e->find_member("k");
+  EXPECT_EQ_DOUBLE(1.0, e->get_number());
+
+  /* an empty array or object counts as a level as well */
+  options.arena = nullptr;
+  options.max_depth = 4;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse(nested(4), options));
+  EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse(nested(3, "[]"), options));
+  EXPECT_EQ_INT(tinyjson::Parse::NESTING_TOO_DEEP,
+                v.parse(nested(4, "{}"), options));
+  EXPECT_EQ_INT(tinyjson::Type::NIL, v.get_type());
+  EXPECT_EQ_INT(tinyjson::Parse::NESTING_TOO_DEEP,
+                v.parse(nested(5, "\"a string past twelve bytes\""),
+                        options));
+  options.max_depth = 0;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse("\"scalar\"", options));
+  EXPECT_EQ_INT(tinyjson::Parse::NESTING_TOO_DEEP, v.parse("[]", options));
+
+  /* the limit holds on several threads and in a batch too */
+  std::string json = "[";
+  for (int i = 0; i < 8000; i++)
+    json += (i == 0 ? "" : ",") + nested(i == 6000 ? 9 : 3);
+  json += "]";
+  options.max_depth = 9;
+  options.threads = 4;
+  EXPECT_EQ_INT(tinyjson::Parse::NESTING_TOO_DEEP, v.parse(json, options));
+  options.max_depth = 10;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse(json, options));
+  EXPECT_EQ_SIZE_T(8000, v.get_array_size());
+
+  tinyjson::Batch batch;
+  options.max_depth = 3;
+  EXPECT_EQ_SIZE_T(
+      1, batch.parse(std::make_shared<std::string>(nested(3) + "\n" +
+                                                   nested(4) + "\n[]"),
+                     2, options));
+  EXPECT_EQ_INT(tinyjson::Parse::NESTING_TOO_DEEP, batch.errors[1]);
+
+  /* ENGINE_STRUCTURAL records are parsed iteratively, and cut off too */
+  options.engine = tinyjson::ENGINE_STRUCTURAL;
+  EXPECT_EQ_SIZE_T(
+      1, batch.parse(std::make_shared<std::string>(nested(3) + "\n" +
+                                                   nested(4) + "\n[]"),
+                     2, options));
+  EXPECT_EQ_INT(tinyjson::Parse::NESTING_TOO_DEEP, batch.errors[1]);
+  options.threads = 1;
+  options.max_depth = 4;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse(nested(3, "[]"), options));
+  EXPECT_EQ_INT(tinyjson::Parse::NESTING_TOO_DEEP,
+                v.parse(nested(4, "{}"), options));
+  options.max_depth = tinyjson::Options().max_depth;
+  EXPECT_EQ_INT(tinyjson::Parse::NESTING_TOO_DEEP,
+                v.parse(nested(2000000), options));
+}
+
+static void test_arena_reset() {
+  tinyjson::Arena arena;
+  arena.reset();
+  EXPECT_EQ_SIZE_T(0, arena.get_block_count());
+  for (int i = 0; i < 1000; i++)
+    std::memset(arena.alloc(100), 'x', 100);
+  size_t capacity = arena.get_capacity();
+  EXPECT_TRUE(arena.get_block_count() > 1);
+
+  /* the same fill again fits in the one block reset() leaves */
+  for (int round = 0; round < 3; round++) {
+    arena.reset();
+    EXPECT_EQ_SIZE_T(1, arena.get_block_count());
+    EXPECT_TRUE(arena.get_capacity() >= capacity);
+    for (int i = 0; i < 1000; i++)
+      std::memset(arena.alloc(100), 'y', 100);
+    EXPECT_EQ_SIZE_T(1, arena.get_block_count());
+  }
+}
+
+static void test_parser() {
+  std::string json = "{\"a\":[1,\"a string past twelve bytes\",{\"b\":null}],"
+                     "\"k\\u0031\":\"x\\ny\"}";
+  tinyjson::Value expect;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, expect.parse(json));
+  for (int mode = 0; mode < 4; mode++) {
+    tinyjson::Options options;
+    options.engine = mode == 1   ? tinyjson::ENGINE_STRUCTURAL
+                     : mode == 2 ? tinyjson::ENGINE_RECURSIVE
+                                 : tinyjson::ENGINE_ITERATIVE;
+    options.zero_copy = mode == 3;
+    tinyjson::Parser parser(options);
+    for (int i = 0; i < 3; i++) {
+      EXPECT_EQ_INT(tinyjson::Parse::OK, parser.parse(json));
+      EXPECT_TRUE(expect.is_equal(parser.root));
+      /* an error leaves nothing behind for the next document */
+      EXPECT_EQ_INT(tinyjson::Parse::MISS_COMMA_OR_CURLY_BRACKET,
+                    parser.parse("{\"a\":[1,2] \"b\":3}"));
+      EXPECT_EQ_INT(tinyjson::Type::NIL, parser.root.get_type());
+      EXPECT_EQ_INT(tinyjson::Parse::OK, parser.parse(" [[\"" +
+                                                      std::string(300, 'z') +
+                                                      "\"], 2] "));
+      EXPECT_EQ_SIZE_T(2, parser.root.get_array_size());
+      EXPECT_EQ_SIZE_T(300, parser.root.get_array_elem(0)
+                                ->get_array_elem(0)
+                                ->get_string_len());
+    }
+    parser.reset();
+    EXPECT_EQ_INT(tinyjson::Type::NIL, parser.root.get_type());
+  }
+
+  /* documents of every size after one another */
+  tinyjson::Parser parser;
+  for (int i = 0; i < 200; i++) {
+    std::string random = random_json(1 + i % 5);
+    tinyjson::Value v;
+    tinyjson::Parse ret = v.parse(random);
+    EXPECT_EQ_INT(ret, parser.parse(random));
+    EXPECT_TRUE(v.is_equal(parser.root));
+  }
+}
+
+static void test_parse_into() {
+  std::string json = "{\"id\":1,\"name\":\"a name longer than twelve\","
+                     "\"tags\":[\"first tag here\",\"x\"],\"k\\u0031\":[[]]}";
+  tinyjson::Value expect;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, expect.parse(json));
+  for (int mode = 0; mode < 4; mode++) {
+    tinyjson::Options options;
+    options.engine = mode == 1   ? tinyjson::ENGINE_STRUCTURAL
+                     : mode == 2 ? tinyjson::ENGINE_RECURSIVE
+                                 : tinyjson::ENGINE_ITERATIVE;
+    options.zero_copy = mode == 3;
+    tinyjson::Recycler recycler;
+    /* the first tree comes from plain Value::parse, blocks of exact size */
+    tinyjson::Value v;
+    EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse(json, options));
+    EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse_into(json, recycler, options));
+    EXPECT_TRUE(expect.is_equal(v));
+    size_t mallocs = recycler.get_malloc_count();
+    size_t blocks = recycler.get_block_count();
+    for (int i = 0; i < 3; i++) {
+      EXPECT_EQ_INT(tinyjson::Parse::OK,
+                    v.parse_into(json, recycler, options));
+      EXPECT_TRUE(expect.is_equal(v));
+      /* the same shape again takes every block from the recycler */
+      EXPECT_EQ_SIZE_T(mallocs, recycler.get_malloc_count());
+      EXPECT_EQ_SIZE_T(blocks, recycler.get_block_count());
+    }
+    /* a smaller document leaves blocks over, a larger one takes them back */
+    EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse_into("[1]", recycler, options));
+    EXPECT_TRUE(recycler.get_block_count() > 0);
+    EXPECT_EQ_INT(tinyjson::Parse::OK,
+                  v.parse_into(json, recycler, options));
+    EXPECT_TRUE(expect.is_equal(v));
+    EXPECT_EQ_SIZE_T(mallocs, recycler.get_malloc_count());
+    /* an error leaves a NIL and keeps the old blocks */
+    EXPECT_EQ_INT(tinyjson::Parse::MISS_COMMA_OR_CURLY_BRACKET,
+                  v.parse_into("{\"a\":[1,2] \"b\":3}", recycler, options));
+    EXPECT_EQ_INT(tinyjson::Type::NIL, v.get_type());
+    EXPECT_TRUE(recycler.get_block_count() > 0);
+  }
+
+  /* strings of a different length in the same class reuse their buffer */
+  tinyjson::Recycler recycler;
+  tinyjson::Value v;
+  v.parse_into("[\"" + std::string(100, 'a') + "\"]", recycler);
+  size_t mallocs = recycler.get_malloc_count();
+  v.parse_into("[\"" + std::string(97, 'b') + "\"]", recycler);
+  EXPECT_EQ_SIZE_T(mallocs, recycler.get_malloc_count());
+  EXPECT_EQ_SIZE_T(97, v.get_array_elem(0)->get_string_len());
+
+  /* documents of every shape after one another */
+  for (int i = 0; i < 200; i++) {
+    std::string random = random_json(1 + i % 5);
+    tinyjson::Value w;
+    tinyjson::Parse ret = w.parse(random);
+    EXPECT_EQ_INT(ret, v.parse_into(random, recycler));
+    EXPECT_TRUE(w.is_equal(v));
+  }
+  recycler.take(v);
+  EXPECT_EQ_INT(tinyjson::Type::NIL, v.get_type());
+  EXPECT_TRUE(recycler.get_capacity() > 0);
+  recycler.clear();
+  EXPECT_EQ_SIZE_T(0, recycler.get_block_count());
+  EXPECT_EQ_SIZE_T(0, recycler.get_capacity());
+}
+
+/* `b` reads the same as `v`, with members looked up by key */
+static void check_binary(tinyjson::Value &v, const tinyjson::BinaryValue &b) {
+  EXPECT_TRUE(b.is_found());
+  EXPECT_EQ_INT(v.get_type(), b.get_type());
+  switch (v.get_type()) {
+  case tinyjson::Type::NUMBER:
+    EXPECT_EQ_INT(v.get_number_type(), b.get_number_type());
+    EXPECT_EQ_DOUBLE(v.get_number(), b.get_number());
+    break;
+  case tinyjson::Type::STRING:
+    EXPECT_TRUE(v.get_string_view() == b.get_string_view());
+    break;
+  case tinyjson::Type::ARRAY:
+    EXPECT_EQ_SIZE_T(v.get_array_size(), b.get_array_size());
+    for (size_t i = 0; i < v.get_array_size(); i++)
+      check_binary(*v.get_array_elem(i), b.get_array_elem(i));
+    break;
+  case tinyjson::Type::OBJECT:
+    EXPECT_EQ_SIZE_T(v.get_object_size(), b.get_object_size());
+    for (size_t i = 0; i < v.get_object_size(); i++) {
+      std::string_view key = v.get_object_key_view(i);
+      check_binary(*v.find_member(key), b.find_member(key));
+      if (i > 0)
+        EXPECT_TRUE(b.get_object_key_view(i - 1) <= b.get_object_key_view(i));
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+static void test_binary() {
+  std::string json =
+      "{\"z\":[1,-2,18446744073709551615,2.5,-0.0,1e300],\"a\":\"short\","
+      "\"m\":\"a string longer than twelve bytes\",\"e\":\"x\\u0000\\ny\","
+      "\"a\":{\"dup\":true},\"n\":[null,false,true,[],{}],\"b\":{\"y\":{},"
+      "\"x\":[\"\"]}}";
+  tinyjson::Value v;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse(json));
+  tinyjson::BinaryDocument doc;
+  doc.encode(v);
+  EXPECT_EQ_INT(tinyjson::Parse::OK, doc.validate());
+  tinyjson::BinaryValue root = doc.get_root();
+  check_binary(v, root);
+  EXPECT_EQ_SIZE_T(7, root.get_object_size());
+  EXPECT_EQ_STRING("a", root.get_object_key(0).c_str(), 1);
+  EXPECT_EQ_STRING("z", root.get_object_key(6).c_str(), 1);
+  /* equal keys keep their order, and a lookup finds the first */
+  EXPECT_EQ_INT(tinyjson::Type::STRING, root.get_object_value(0).get_type());
+  EXPECT_EQ_INT(tinyjson::Type::OBJECT, root.get_object_value(1).get_type());
+  EXPECT_EQ_STRING("short", root.find_member("a").get_string().c_str(), 5);
+  EXPECT_EQ_UINT64(UINT64_MAX,
+                   root.find_member("z").get_array_elem(2).get_uint64());
+  EXPECT_EQ_INT64(-2, root.find_member("z").get_array_elem(1).get_int64());
+  EXPECT_EQ_SIZE_T(4, root.find_member("e").get_string_len());
+  EXPECT_TRUE(!root.find_member("c").is_found());
+  EXPECT_TRUE(!root.find_member("zz").is_found());
+  EXPECT_TRUE(!root.find_member("m").find_member("a").is_found());
+  EXPECT_EQ_INT(tinyjson::Type::NIL, root.find_member("").get_type());
+
+  /* text, binary and tree convert into each other */
+  tinyjson::Value sorted;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, sorted.parse(doc.stringify()));
+  tinyjson::Arena arena;
+  tinyjson::Value decoded, in_arena;
+  root.get_value(decoded);
+  root.get_value(in_arena, &arena);
+  EXPECT_TRUE(sorted.is_equal(decoded));
+  EXPECT_TRUE(sorted.is_equal(in_arena));
+  EXPECT_TRUE(decoded.stringify() == doc.stringify());
+  tinyjson::BinaryDocument from_text;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, from_text.parse(json));
+  EXPECT_EQ_SIZE_T(doc.get_size(), from_text.get_size());
+  EXPECT_TRUE(std::memcmp(doc.get_data(), from_text.get_data(),
+                          doc.get_size()) == 0);
+  EXPECT_EQ_INT(tinyjson::Parse::MISS_COMMA_OR_CURLY_BRACKET,
+                from_text.parse("{\"a\":1 \"b\":2}"));
+  EXPECT_TRUE(!from_text.get_root().is_found());
+
+  /* the bytes are read in place, wherever they are */
+  std::string bytes = "x" + std::string(doc.get_data(), doc.get_size());
+  tinyjson::BinaryDocument view;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, view.open(&bytes[1], doc.get_size()));
+  EXPECT_EQ_INT(tinyjson::Parse::OK, view.validate());
+  check_binary(v, view.get_root());
+  EXPECT_EQ_INT(tinyjson::Parse::INVALID_BINARY,
+                view.open(&bytes[1], doc.get_size() - 1));
+  EXPECT_EQ_INT(tinyjson::Parse::INVALID_BINARY, view.open(json.data(), 32));
+  EXPECT_EQ_INT(tinyjson::Parse::INVALID_BINARY, view.validate());
+  /* as written on a host of the other byte order */
+  std::string swapped(doc.get_data(), doc.get_size());
+  std::reverse(swapped.begin() + 4, swapped.begin() + 8);
+  EXPECT_EQ_INT(tinyjson::Parse::INVALID_BINARY,
+                view.open(swapped.data(), swapped.size()));
+  EXPECT_EQ_INT(tinyjson::Parse::INVALID_BINARY, view.validate());
+
+  /* validate() finds offsets out of bounds, backwards or shared */
+  std::string bad(doc.get_data(), doc.get_size());
+  uint64_t offset;
+  std::memcpy(&offset, &bad[16], sizeof(offset));
+  for (uint64_t to : {(uint64_t)bad.size(), (uint64_t)16, offset + 16}) {
+    std::string copy = bad;
+    std::memcpy(&copy[16], &to, sizeof(to));
+    EXPECT_EQ_INT(tinyjson::Parse::OK, view.open(copy.data(), copy.size()));
+    EXPECT_EQ_INT(tinyjson::Parse::INVALID_BINARY, view.validate());
+  }
+  std::string deep = nested(2000);
+  tinyjson::Options options;
+  options.max_depth = 4000;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, from_text.parse(deep, options));
+  EXPECT_EQ_INT(tinyjson::Parse::NESTING_TOO_DEEP, from_text.validate());
+  EXPECT_EQ_INT(tinyjson::Parse::OK, from_text.validate(2000));
+  EXPECT_TRUE(from_text.stringify() == deep);
+
+  const char *path = "tinyjson_test_file.bin";
+  std::FILE *f = std::fopen(path, "wb");
+  std::fwrite(doc.get_data(), 1, doc.get_size(), f);
+  std::fclose(f);
+  tinyjson::BinaryDocument file;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, file.open_file(path));
+  check_binary(v, file.get_root());
+  std::remove(path);
+  EXPECT_EQ_INT(tinyjson::Parse::FILE_ERROR, file.open_file(path));
+  EXPECT_TRUE(!file.get_root().is_found());
+
+  for (int i = 0; i < 200; i++) {
+    std::string random = random_json(1 + i % 5);
+    tinyjson::Value w;
+    if (w.parse(random) != tinyjson::Parse::OK)
+      continue;
+    doc.encode(w);
+    EXPECT_EQ_INT(tinyjson::Parse::OK, doc.validate());
+    check_binary(w, doc.get_root());
+  }
+}
+
+static void test_tape() {
+  tinyjson::Tape tape;
+  EXPECT_TRUE(!tape.get_root().is_found());
+  EXPECT_EQ_INT(tinyjson::Parse::OK, tape.parse(" [1,{\"a\":true}] "));
+  /* [ l 1 { " t } ] */
+  EXPECT_EQ_SIZE_T(8, tape.get_size());
+  tinyjson::TapeValue root = tape.get_root();
+  EXPECT_EQ_SIZE_T(8, root.get_next());
+  EXPECT_EQ_SIZE_T(2, root.get_array_size());
+  EXPECT_EQ_INT64(1, root.get_array_elem(0).get_int64());
+  EXPECT_TRUE(root.get_array_elem(1).find_member("a").get_boolean());
+  EXPECT_TRUE(!root.get_array_elem(2).is_found());
+
+  std::string json =
+      "{\"deep\":[[[[1,2],[3]],{\"x\":[4]}]],\"n\":null,\"f\":false,"
+      "\"s\":\"a string longer than twelve\",\"e\":\"x\\u0000\\ny\","
+      "\"i\":-7,\"u\":18446744073709551615,\"d\":2.5,\"deep\":[],"
+      "\"o\":{},\"a\":[\"\",[],{}]}";
+  EXPECT_EQ_INT(tinyjson::Parse::OK, tape.parse(json));
+  root = tape.get_root();
+  EXPECT_EQ_SIZE_T(11, root.get_object_size());
+  /* moving on from a member steps over all of it at once */
+  tinyjson::TapeIterator it = root.begin();
+  EXPECT_EQ_STRING("deep", std::string(it.key()).c_str(), 4);
+  ++it;
+  EXPECT_EQ_STRING("n", std::string(it.key()).c_str(), 1);
+  EXPECT_EQ_INT(tinyjson::Type::NIL, (*it).get_type());
+  EXPECT_TRUE((*it).is_found());
+  size_t members = 0;
+  for (it = root.begin(); it != root.end(); ++it)
+    members++;
+  EXPECT_EQ_SIZE_T(11, members);
+  EXPECT_EQ_SIZE_T(1, root.find_member("deep").get_array_size());
+  EXPECT_TRUE(!root.find_member("missing").is_found());
+  EXPECT_EQ_SIZE_T(4, root.find_member("e").get_string_len());
+  EXPECT_EQ_INT64(-7, root.find_member("i").get_int64());
+  EXPECT_EQ_UINT64(UINT64_MAX, root.find_member("u").get_uint64());
+  EXPECT_EQ_DOUBLE(2.5, root.find_member("d").get_number());
+  EXPECT_EQ_INT(tinyjson::Number::NUMBER_DOUBLE,
+                root.find_member("d").get_number_type());
+  int64_t sum = 0;
+  for (tinyjson::TapeValue pair : root.find_member("deep").get_array_elem(0)
+                                      .get_array_elem(0))
+    for (tinyjson::TapeValue n : pair)
+      sum += n.get_int64();
+  EXPECT_EQ_INT64(6, sum);
+
+  /* the same tree and text as Value::parse */
+  tinyjson::Value expect, v;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, expect.parse(json));
+  root.get_value(v);
+  EXPECT_TRUE(expect.is_equal(v));
+  tinyjson::Arena arena;
+  root.get_value(v, &arena);
+  EXPECT_TRUE(expect.is_equal(v));
+  EXPECT_TRUE(expect.stringify() == tape.stringify());
+
+  for (const char *bad : {"", " ", "[1,]", "{\"a\" 1}", "\"\\x\"", "[\"a\"",
+                          "nul", "-"}) {
+    tinyjson::Value w;
+    EXPECT_EQ_INT(w.parse(bad), tape.parse(bad));
+    EXPECT_TRUE(!tape.get_root().is_found());
+    EXPECT_EQ_SIZE_T(0, tape.get_size());
+  }
+
+  for (int i = 0; i < 200; i++) {
+    std::string random = random_json(1 + i % 5);
+    tinyjson::Value w;
+    tinyjson::Parse ret = w.parse(random);
+    EXPECT_EQ_INT(ret, tape.parse(random));
+    if (ret != tinyjson::Parse::OK)
+      continue;
+    EXPECT_EQ_SIZE_T(tape.get_size(), tape.get_root().get_next());
+    tape.get_root().get_value(v);
+    EXPECT_TRUE(w.is_equal(v));
+    EXPECT_TRUE(w.stringify() == tape.stringify());
+  }
+
+  /* nesting is cut off at max_depth, as in a Value */
+  EXPECT_EQ_INT(tinyjson::Parse::NESTING_TOO_DEEP,
+                tape.parse(std::string(2000000, '[')));
+  EXPECT_EQ_SIZE_T(0, tape.get_size());
+  EXPECT_EQ_INT(tinyjson::Parse::OK, tape.parse(nested(3, "[]"), 4));
+  EXPECT_EQ_INT(tinyjson::Parse::NESTING_TOO_DEEP,
+                tape.parse(nested(4, "{}"), 4));
+}
+
+static void test_parse_file() {
+  const char *path = "tinyjson_test_file.json";
+  /* one whole page, so a mapping would have no zero byte after it */
+  std::string json = "[\"";
+  json += std::string(4096 - 4, 'x');
+  json += "\"]";
+  for (size_t size : {json.size(), (size_t)1234}) {
+    std::string text = json.substr(0, size);
+    std::FILE *f = std::fopen(path, "wb");
+    std::fwrite(text.data(), 1, text.size(), f);
+    std::fclose(f);
+    tinyjson::Value expect;
+    tinyjson::Parse ret = expect.parse(std::make_shared<std::string>(text));
+    for (bool zero_copy : {false, true}) {
+      tinyjson::Document doc;
+      tinyjson::Options options;
+      options.zero_copy = zero_copy;
+      EXPECT_EQ_INT(ret, doc.parse_file(path, options));
+      EXPECT_EQ_SIZE_T(text.size(), doc.file.get_size());
+      EXPECT_TRUE(expect.is_equal(doc.root));
+    }
+  }
+
+  std::fclose(std::fopen(path, "wb"));
+  tinyjson::Document doc;
+  EXPECT_EQ_INT(tinyjson::Parse::EXPECT_VALUE, doc.parse_file(path));
+  std::remove(path);
+  EXPECT_EQ_INT(tinyjson::Parse::FILE_ERROR, doc.parse_file(path));
+
+  /* views and raw buffers need no std::string around them */
+  std::string_view view = "{\"a\":[1,2]} trailing";
+  tinyjson::Value v;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse(view.substr(0, 11)));
+  EXPECT_EQ_SIZE_T(2, v.get_object_value(0)->get_array_size());
+  EXPECT_EQ_INT(tinyjson::Parse::MISS_COMMA_OR_CURLY_BRACKET,
+                v.parse(view.data(), 10));
+  EXPECT_EQ_INT(tinyjson::Parse::OK, doc.parse(view.data(), 11));
+  EXPECT_EQ_INT(tinyjson::Type::OBJECT, doc.root.get_type());
+}
+
+/* Writes the events back out as JSON, to compare with Value::stringify(). */
+struct EventWriter {
+  std::string out;
+  std::vector<bool> first{true};
+
+  void separate() {
+    if (!this->first.back() && this->out.back() != ':')
+      this->out += ',';
+    this->first.back() = false;
+  }
+  void scalar(tinyjson::Value &v) {
+    this->separate();
+    this->out += v.stringify();
+  }
+  void on_null() {
+    tinyjson::Value v;
+    this->scalar(v);
+  }
+  void on_bool(bool b) {
+    tinyjson::Value v;
+    v.set_boolean(b);
+    this->scalar(v);
+  }
+  void on_number(tinyjson::Value &num) { this->scalar(num); }
+  void on_string(std::string_view str) {
+    tinyjson::Value v;
+    v.set_cstring(str.data(), str.size());
+    this->scalar(v);
+  }
+  void on_key(std::string_view key) {
+    this->on_string(key);
+    this->out += ':';
+  }
+  void on_start_array() {
+    this->separate();
+    this->out += '[';
+    this->first.push_back(true);
+  }
+  void on_end_array(size_t) {
+    this->out += ']';
+    this->first.pop_back();
+  }
+  void on_start_object() {
+    this->separate();
+    this->out += '{';
+    this->first.push_back(true);
+  }
+  void on_end_object(size_t) {
+    this->out += '}';
+    this->first.pop_back();
+  }
+};
+
+static void check_sax(const std::string &json) {
+  auto s = std::make_shared<std::string>(json);
+  tinyjson::Value expect, actual;
+  tinyjson::Arena arena;
+  tinyjson::Parse ret = expect.parse(s);
+  {
+    tinyjson::Builder builder(actual);
+    EXPECT_EQ_INT(ret, tinyjson::parse_sax(s, builder));
+  }
+  if (ret != tinyjson::Parse::OK)
+    return;
+  EXPECT_TRUE(expect.is_equal(actual));
+
+  {
+    tinyjson::Builder builder(actual, &arena);
+    EXPECT_EQ_INT(ret, tinyjson::parse_sax(s, builder));
+  }
+  EXPECT_TRUE(expect.is_equal(actual));
+  actual.release();
+
+  EventWriter writer;
+  EXPECT_EQ_INT(ret, tinyjson::parse_sax(s, writer));
+  EXPECT_TRUE(writer.out == expect.stringify());
+}
+
+static void test_parse_sax() {
+  check_sax("null");
+  check_sax("  [ 1 , -2.5e3 , 18446744073709551615 , true , false ] ");
+  check_sax("{\"a\":{\"b\":[{},[],\"\\u20AC\\n\"]},\"\\\"k\":\"v\"}");
+  check_sax("");
+  check_sax("[1,");
+  check_sax("{\"a\" 1}");
+  check_sax("[\"\\x\"]");
+  for (int i = 0; i < 200; i++) {
+    std::string json = random_json(5);
+    check_sax(json);
+    std::string broken = json;
+    if (!broken.empty())
+      broken[next_rand() % broken.size()] = "[]{}\",:\\ x1"[next_rand() % 12];
+    check_sax(broken);
+    check_sax(json.substr(0, next_rand() % (json.size() + 1)));
+  }
+
+  /* nesting is cut off at max_depth, well before the stack runs out */
+  EventWriter writer;
+  auto deep = std::make_shared<std::string>(2000000, '[');
+  auto three = std::make_shared<std::string>("[{\"k\":[]}]");
+  auto four = std::make_shared<std::string>("[{\"k\":[{}]}]");
+  EXPECT_EQ_INT(tinyjson::Parse::NESTING_TOO_DEEP,
+                tinyjson::parse_sax(deep, writer));
+  EXPECT_EQ_INT(tinyjson::Parse::OK, tinyjson::parse_sax(three, writer, 3));
+  EXPECT_EQ_INT(tinyjson::Parse::NESTING_TOO_DEEP,
+                tinyjson::parse_sax(four, writer, 3));
+}
+
+/* Feeds `json` in chunks of random size and compares with Value::parse. */
+static void check_stream(const std::string &json) {
+  tinyjson::Value expect, actual;
+  tinyjson::Parse ret = expect.parse(std::make_shared<std::string>(json));
+  tinyjson::StreamParser sp;
+  tinyjson::Feed r = tinyjson::FEED_MORE;
+  size_t pos = 0, used;
+  while (pos < json.size() && r == tinyjson::FEED_MORE) {
+    size_t n = std::min<size_t>(json.size() - pos, next_rand() % 8 + 1);
+    r = sp.feed(json.data() + pos, n, &used);
+    pos += used;
+  }
+  if (r == tinyjson::FEED_MORE)
+    r = sp.finish();
+  if (ret != tinyjson::Parse::OK) {
+    EXPECT_EQ_INT(tinyjson::FEED_ERROR, r);
+    EXPECT_EQ_INT(ret, sp.get_error());
+    return;
+  }
+  EXPECT_EQ_INT(tinyjson::FEED_VALUE, r);
+  sp.take(actual);
+  EXPECT_TRUE(expect.is_equal(actual));
+}
+
+static void test_parse_stream() {
+  check_stream("null");
+  check_stream(" \"\\u00e9t\\u00e9 \\uD834\\uDD1E\" ");
+  check_stream("[1.5e-3,-0,{\"a\":[true,false,null]},\"x\",123456789012]");
+  check_stream("");
+  check_stream("[");
+  check_stream("{\"a\"");
+  check_stream("{\"a\":");
+  check_stream("{\"a\":1");
+  check_stream("{\"a\":1,");
+  check_stream("\"abc");
+  check_stream("\"abc\\");
+  check_stream("\"\\u12");
+  check_stream("\"\\q\x01\"");
+  check_stream("[nul]");
+  check_stream("-");
+  check_stream("1e309");
+  check_stream("[01]");
+  for (int i = 0; i < 200; i++) {
+    std::string json = random_json(5);
+    check_stream(json);
+    std::string broken = json;
+    if (!broken.empty())
+      broken[next_rand() % broken.size()] = "[]{}\",:\\ x1"[next_rand() % 12];
+    check_stream(broken);
+    check_stream(json.substr(0, next_rand() % (json.size() + 1)));
+  }
+
+  /* several values in one stream, one byte at a time */
+  const char lines[] = "{\"id\":1}\n[2] \"three\"4 5\ntrue\n-7";
+  const char *expect[] = {"{\"id\":1}", "[2]", "\"three\"", "4",
+                          "5",           "true", "-7"};
+  tinyjson::StreamParser sp;
+  tinyjson::Value v;
+  size_t count = 0, used;
+  for (size_t i = 0; i < sizeof(lines) - 1; i++) {
+    if (sp.feed(lines + i, 1, &used) == tinyjson::FEED_VALUE) {
+      sp.take(v);
+      EXPECT_TRUE(v.stringify() == expect[count++]);
+    }
+  }
+  EXPECT_EQ_INT(tinyjson::FEED_VALUE, sp.finish());
+  sp.take(v);
+  EXPECT_TRUE(v.stringify() == expect[count++]);
+  EXPECT_EQ_INT(tinyjson::FEED_END, sp.finish());
+  EXPECT_EQ_SIZE_T(7, count);
+
+  /* an error sticks until reset() */
+  EXPECT_EQ_INT(tinyjson::FEED_ERROR, sp.feed("]", 1, &used));
+  EXPECT_EQ_INT(tinyjson::Parse::INVALID_VALUE, sp.get_error());
+  EXPECT_EQ_INT(tinyjson::FEED_ERROR, sp.feed("1", 1, &used));
+  sp.reset();
+  EXPECT_EQ_INT(tinyjson::FEED_MORE, sp.feed("[1,{\"a\":", 8, &used));
+  EXPECT_EQ_INT(tinyjson::FEED_VALUE, sp.feed("2}]", 3, &used));
+  EXPECT_EQ_SIZE_T(3, used);
+  sp.take(v);
+  EXPECT_TRUE(v.stringify() == "[1,{\"a\":2}]");
+
+  /* what a peer can make it buffer is bounded */
+  std::string deep(1000000, '[');
+  sp.reset();
+  EXPECT_EQ_INT(tinyjson::FEED_ERROR,
+                sp.feed(deep.data(), deep.size(), &used));
+  EXPECT_EQ_INT(tinyjson::Parse::NESTING_TOO_DEEP, sp.get_error());
+  tinyjson::Options options;
+  options.max_depth = 3;
+  options.max_token = 4;
+  tinyjson::StreamParser limited(options);
+  EXPECT_EQ_INT(tinyjson::FEED_VALUE, limited.feed("[{\"k\":[]}]", 10, &used));
+  EXPECT_EQ_INT(tinyjson::FEED_ERROR,
+                limited.feed("[{\"k\":[{}]}]", 12, &used));
+  EXPECT_EQ_INT(tinyjson::Parse::NESTING_TOO_DEEP, limited.get_error());
+  limited.reset();
+  EXPECT_EQ_INT(tinyjson::FEED_VALUE, limited.feed("\"ab\" ", 5, &used));
+  EXPECT_EQ_INT(tinyjson::FEED_VALUE, limited.feed("1234 ", 5, &used));
+  EXPECT_EQ_INT(tinyjson::FEED_MORE, limited.feed("\"a", 2, &used));
+  EXPECT_EQ_INT(tinyjson::FEED_ERROR, limited.feed("bcd", 3, &used));
+  EXPECT_EQ_INT(tinyjson::Parse::DOCUMENT_TOO_LARGE, limited.get_error());
+  limited.reset();
+  EXPECT_EQ_INT(tinyjson::FEED_ERROR, limited.feed("12345", 5, &used));
+  EXPECT_EQ_INT(tinyjson::Parse::DOCUMENT_TOO_LARGE, limited.get_error());
+}
+
+static void test_parse_lines() {
+  std::string json;
+  std::vector<std::string> lines;
+  std::vector<tinyjson::Parse> expect;
+  for (int i = 0; i < 1000; i++) {
+    tinyjson::Value v;
+    v.parse(std::make_shared<std::string>(random_json(3)));
+    std::string line = v.stringify();
+    tinyjson::Parse ret = tinyjson::Parse::OK;
+    switch (next_rand() % 16) {
+    case 0:
+      line = line.substr(0, next_rand() % (line.size() + 1));
+      ret = v.parse(std::make_shared<std::string>(line));
+      break;
+    case 1:
+      line += " x";
+      ret = tinyjson::Parse::ROOT_NOT_SINGULAR;
+      break;
+    case 2:
+      /* would run on into the next line if that were allowed */
+      line = "[1,";
+      ret = tinyjson::Parse::EXPECT_VALUE;
+      break;
+    }
+    json += line + (i % 7 == 0 ? "\r\n" : "\n");
+    if (i % 50 == 0)
+      json += " \t\n"; /* blank lines are not records */
+    if (!line.empty()) {
+      lines.push_back(line);
+      expect.push_back(ret);
+    }
+  }
+  json += "{\"last\":\"line without a newline\"}";
+  lines.push_back("{\"last\":\"line without a newline\"}");
+  expect.push_back(tinyjson::Parse::OK);
+  auto input = std::make_shared<const std::string>(json);
+  size_t expect_failed =
+      lines.size() - std::count(expect.begin(), expect.end(), tinyjson::OK);
+
+  for (unsigned threads : {1u, 4u}) {
+    for (bool zero_copy : {false, true}) {
+      tinyjson::Batch batch;
+      tinyjson::Options options;
+      options.zero_copy = zero_copy;
+      EXPECT_EQ_SIZE_T(expect_failed, batch.parse(input, threads, options));
+      EXPECT_EQ_SIZE_T(lines.size(), batch.get_size());
+      if (batch.get_size() != lines.size())
+        continue;
+      for (size_t i = 0; i < lines.size(); i++) {
+        EXPECT_EQ_INT(expect[i], batch.errors[i]);
+        EXPECT_EQ_SIZE_T(json.find(lines[i], batch.offsets[i]),
+                         batch.offsets[i]);
+        if (expect[i] == tinyjson::Parse::OK)
+          EXPECT_TRUE(batch.values[i].stringify() == lines[i]);
+      }
+    }
+  }
+
+  tinyjson::Batch empty;
+  EXPECT_EQ_SIZE_T(0, empty.parse(std::make_shared<std::string>("\n \n")));
+  EXPECT_EQ_SIZE_T(0, empty.get_size());
+}
+
+static void check_parallel(const std::string &json) {
+  auto s = std::make_shared<std::string>(json);
+  tinyjson::Value expect;
+  tinyjson::Parse ret = expect.parse(s);
+  tinyjson::Options options;
+  options.threads = 4;
+  for (int mode = 0; mode < 3; mode++) {
+    tinyjson::Arena arena;
+    options.arena = mode == 1 ? &arena : nullptr;
+    options.zero_copy = mode == 2;
+    tinyjson::Value actual;
+    EXPECT_EQ_INT(ret, actual.parse(s, options));
+    EXPECT_TRUE(expect.is_equal(actual));
+  }
+}
+
+static void test_parse_parallel() {
+  /* strings full of brackets, commas and escaped quotes around the splits */
+  std::string json = "[";
+  for (int i = 0; i < 3000; i++) {
+    if (i != 0)
+      json += i % 3 ? "," : " ,\n";
+    json += i % 5 ? random_json(3) : "\"],[{\\\"\\\\,\"";
+  }
+  json += "]";
+  check_parallel(json);
+  check_parallel("  " + json + "  ");
+
+  tinyjson::Value v;
+  tinyjson::Options options;
+  options.threads = 4;
+  EXPECT_EQ_INT(tinyjson::Parse::OK,
+                v.parse(std::make_shared<std::string>(json), options));
+  EXPECT_EQ_SIZE_T(3000, v.get_array_size());
+
+  for (int i = 0; i < 20; i++) {
+    std::string broken = json;
+    broken[next_rand() * 7 % broken.size()] = "[]{}\",:\\ x1"[next_rand() % 12];
+    check_parallel(broken);
+    check_parallel(json.substr(0, next_rand() * 7 % json.size()));
+  }
+  check_parallel(std::string(100000, ' ') + "[1,2]");
+  check_parallel("{\"a\":" + json + "}");
+}
+
+/* Hashed and scanned lookups must find the same member a scan would. */
+static void check_find_member(tinyjson::Value &v, size_t width) {
+  EXPECT_EQ_INT(tinyjson::Type::OBJECT, v.get_type());
+  for (size_t i = 0; i < v.get_object_size(); i++) {
+    std::string_view key = v.get_object_key_view(i);
+    size_t first = i;
+    for (size_t j = 0; j < i; j++) {
+      if (v.get_object_key_view(j) == key) {
+        first = j;
+        break;
+      }
+    }
+    EXPECT_TRUE(v.get_object_value(first) == v.find_member(key));
+  }
+  EXPECT_TRUE(v.find_member("missing") == nullptr);
+  EXPECT_TRUE(v.find_member("") == nullptr);
+  EXPECT_TRUE(v.find_member("k" + std::to_string(width)) == nullptr);
+}
+
+static void test_find_member() {
+  for (size_t width : {0, 1, 4, 15, 16, 17, 100, 1000}) {
+    std::string json = "{";
+    for (size_t i = 0; i < width; i++) {
+      if (i != 0)
+        json += ",";
+      json += "\"k" + std::to_string(i) + "\":" + std::to_string(i);
+    }
+    json += "}";
+    auto s = std::make_shared<std::string>(json);
+    for (int mode = 0; mode < 4; mode++) {
+      tinyjson::Value v;
+      tinyjson::Arena arena;
+      tinyjson::Options options;
+      options.arena = mode == 1 ? &arena : nullptr;
+      options.engine = mode == 2 ? tinyjson::ENGINE_STRUCTURAL
+                                 : tinyjson::ENGINE_RECURSIVE;
+      options.zero_copy = mode == 3;
+      EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse(s, options));
+      check_find_member(v, width);
+      for (size_t i = 0; i < width; i++) {
+        tinyjson::Value *m = v.find_member("k" + std::to_string(i));
+        EXPECT_TRUE(m != nullptr && (size_t)m->get_number() == i);
+      }
+      if (mode != 1)
+        v.release();
+    }
+    tinyjson::Value v;
+    {
+      tinyjson::Builder builder(v);
+      EXPECT_EQ_INT(tinyjson::Parse::OK, tinyjson::parse_sax(s, builder));
+    }
+    check_find_member(v, width);
+  }
+
+  /* the first of duplicate keys wins, escaped keys still match */
+  std::string json = "{";
+  for (int i = 0; i < 40; i++)
+    json += "\"d" + std::to_string(i % 7) + "\":" + std::to_string(i) + ",";
+  json += "\"\\u0041\":1,\"long key past eight bytes\":2}";
+  auto s = std::make_shared<std::string>(json);
+  for (bool zero_copy : {false, true}) {
+    tinyjson::Value v;
+    tinyjson::Options options;
+    options.zero_copy = zero_copy;
+    EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse(s, options));
+    EXPECT_TRUE(v.flags & tinyjson::FLAG_HASHED);
+    check_find_member(v, 0);
+    EXPECT_EQ_DOUBLE(3.0, v.find_member("d3")->get_number());
+    EXPECT_EQ_DOUBLE(1.0, v.find_member("A")->get_number());
+    EXPECT_EQ_DOUBLE(2.0, v.find_member("long key past eight bytes")
+                              ->get_number());
+  }
+}
+
+static void test_parse_intern() {
+  auto json = std::make_shared<std::string>(
+      "[{\"customer_identifier\":1,\"k\":\"a long repeated value\"},"
+      "{\"customer_identifier\":2,\"k\":\"a long repeated value\"}]");
+  tinyjson::InternPool pool;
+  tinyjson::Options options;
+  options.intern = &pool;
+  for (int mode = 0; mode < 4; mode++) {
+    tinyjson::Value a, b;
+    tinyjson::Arena arena;
+    options.arena = mode == 1 ? &arena : nullptr;
+    options.engine = mode == 2 ? tinyjson::ENGINE_STRUCTURAL
+                               : tinyjson::ENGINE_RECURSIVE;
+    options.intern_values = mode == 3;
+    EXPECT_EQ_INT(tinyjson::Parse::OK, a.parse(json, options));
+    EXPECT_EQ_INT(tinyjson::Parse::OK, b.parse(json));
+    EXPECT_TRUE(a.is_equal(b));
+    /* both documents and both records share one copy of the long key */
+    std::string_view key = a.get_array_elem(0)->get_object_key_view(0);
+    EXPECT_TRUE(key.data() == pool.intern("customer_identifier").data());
+    EXPECT_TRUE(key.data() ==
+                a.get_array_elem(1)->get_object_key_view(0).data());
+    EXPECT_TRUE(a.get_array_elem(1)->find_member(key) ==
+                a.get_array_elem(1)->get_object_value(0));
+    const char *v0 = a.get_array_elem(0)->get_object_value(1)
+                         ->get_string_data();
+    const char *v1 = a.get_array_elem(1)->get_object_value(1)
+                         ->get_string_data();
+    EXPECT_TRUE((v0 == v1) == (mode == 3));
+    if (mode != 1)
+      a.release();
+    b.release();
+  }
+  /* "k" is inline, the value only pooled once asked to */
+  EXPECT_EQ_SIZE_T(2, pool.get_size());
+  EXPECT_TRUE(pool.intern("").data() != nullptr);
+  EXPECT_EQ_SIZE_T(3, pool.get_size());
+
+  /* threads share the pool */
+  std::string lines, array = "[";
+  for (int i = 0; i < 2000; i++) {
+    std::string record = "{\"field_number_" + std::to_string(i % 50) +
+                         "\":\"value " + std::to_string(i % 300) +
+                         " of the field\"}";
+    lines += record + "\n";
+    array += (i ? "," : "") + record;
+  }
+  array += "]";
+  options = tinyjson::Options();
+  options.intern = &pool;
+  options.intern_values = true;
+  tinyjson::Batch batch;
+  EXPECT_EQ_SIZE_T(0, batch.parse(std::make_shared<std::string>(lines), 4,
+                                  options));
+  EXPECT_EQ_SIZE_T(3 + 50 + 300, pool.get_size());
+  tinyjson::Value v, expect;
+  options.threads = 4;
+  auto s = std::make_shared<std::string>(array);
+  EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse(s, options));
+  EXPECT_EQ_INT(tinyjson::Parse::OK, expect.parse(s));
+  EXPECT_TRUE(expect.is_equal(v));
+  EXPECT_EQ_SIZE_T(3 + 50 + 300, pool.get_size());
+  for (size_t i = 0; i < batch.get_size(); i++)
+    EXPECT_TRUE(batch.values[i].is_equal(*v.get_array_elem(i)));
+  v.release();
+  expect.release();
+}
+
+/* Every value a cursor reaches must decode to what a full parse gives. */
+static void check_cursor(tinyjson::Cursor cur, tinyjson::Value &v) {
+  EXPECT_TRUE(cur.is_found());
+  EXPECT_EQ_INT(v.get_type(), cur.get_type());
+  tinyjson::Value raw;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, raw.parse(cur.get_raw()));
+  EXPECT_TRUE(v.is_equal(raw));
+  switch (v.get_type()) {
+  case tinyjson::Type::ARRAY:
+    for (size_t i = 0; i < v.get_array_size(); i++)
+      check_cursor(cur[i], *v.get_array_elem(i));
+    EXPECT_TRUE(!cur[v.get_array_size()].is_found());
+    EXPECT_EQ_INT(tinyjson::Parse::OK, cur[v.get_array_size()].get_error());
+    break;
+  case tinyjson::Type::OBJECT:
+    for (size_t i = 0; i < v.get_object_size(); i++) {
+      std::string key = v.get_object_key(i);
+      check_cursor(cur[key], *v.find_member(key));
+    }
+    EXPECT_TRUE(!cur["missing"].is_found());
+    break;
+  case tinyjson::Type::STRING:
+    EXPECT_TRUE(v.get_string() == cur.get_string());
+    break;
+  case tinyjson::Type::NUMBER:
+    EXPECT_EQ_DOUBLE(v.get_number(), cur.get_number());
+    break;
+  case tinyjson::Type::TRUE:
+  case tinyjson::Type::FALSE:
+    EXPECT_EQ_INT(v.get_boolean(), cur.get_boolean());
+    break;
+  default:
+    break;
+  }
+}
+
+static void test_cursor() {
+  std::string json = "{\"skip\":[{\"a\":\"]}\\\"\"},[[]]],\"n\":-1.5e3, "
+                     "\"user\":{\"name\":\"\\u4e2d\",\"id\":"
+                     "9007199254740993},\"list\":[true,null,\"x\"]}";
+  tinyjson::Cursor doc(json);
+  EXPECT_EQ_INT64(9007199254740993, doc["user"]["id"].get_int64());
+  EXPECT_TRUE(doc["user"]["name"].get_string() == "\xE4\xB8\xAD");
+  EXPECT_EQ_DOUBLE(-1500.0, doc["n"].get_number());
+  EXPECT_TRUE(doc["list"][0].get_boolean());
+  EXPECT_EQ_INT(tinyjson::Type::NIL, doc["list"][1].get_type());
+  EXPECT_TRUE(doc["list"][2].get_string() == "x");
+  EXPECT_TRUE(doc["skip"][0]["a"].get_string() == "]}\"");
+  EXPECT_TRUE(doc["skip"][1].get_raw() == "[[]]");
+
+  /* what is missing stays missing further down, and reads as zero */
+  EXPECT_TRUE(!doc["user"]["email"].is_found());
+  EXPECT_TRUE(!doc["nope"]["id"][3].is_found());
+  EXPECT_EQ_INT(tinyjson::Parse::OK, doc["nope"]["id"].get_error());
+  EXPECT_EQ_INT64(0, doc["nope"].get_int64());
+  EXPECT_TRUE(doc["nope"].get_string().empty());
+  EXPECT_TRUE(!doc["n"]["x"].is_found());
+  EXPECT_TRUE(!doc["list"]["x"].is_found());
+  EXPECT_TRUE(!doc[0].is_found());
+  EXPECT_TRUE(!tinyjson::Cursor().is_found());
+  EXPECT_EQ_INT(tinyjson::Parse::EXPECT_VALUE,
+                tinyjson::Cursor(" ").get_error());
+
+  tinyjson::Value v;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, doc["user"].get_value(v));
+  EXPECT_EQ_SIZE_T(2, v.get_object_size());
+  EXPECT_EQ_INT(tinyjson::Parse::EXPECT_VALUE, doc["nope"].get_value(v));
+
+  /* errors on the way are reported, those in skipped values are not */
+  struct {
+    const char *json;
+    tinyjson::Parse error;
+  } broken[] = {
+      {"{\"a\":[1,2,\"]\"", tinyjson::Parse::MISS_COMMA_OR_SQUARE_BRACKET},
+      {"{\"a\":{\"b\":1", tinyjson::Parse::MISS_COMMA_OR_CURLY_BRACKET},
+      {"{\"a\":\"x\\", tinyjson::Parse::MISS_QUOTATION_MARK},
+      {"{\"a\":\"x", tinyjson::Parse::MISS_QUOTATION_MARK},
+      {"{\"a\":1 \"b\":2}", tinyjson::Parse::MISS_COMMA_OR_CURLY_BRACKET},
+      {"{\"a\" 1}", tinyjson::Parse::MISS_COLON},
+      {"{\"a\":1,b:2}", tinyjson::Parse::MISS_KEY},
+      {"{\"a\":tru,\"b\":2}", tinyjson::Parse::INVALID_VALUE},
+      {"{\"a", tinyjson::Parse::MISS_QUOTATION_MARK},
+      {"{\"a\":[1,,x],\"b\":2}", tinyjson::Parse::OK},
+  };
+  for (auto &b : broken) {
+    /* exactly sized, so a read past the end shows up under ASan */
+    size_t len = std::strlen(b.json);
+    std::unique_ptr<char[]> buf(new char[len]);
+    std::memcpy(buf.get(), b.json, len);
+    tinyjson::Cursor cur(buf.get(), len);
+    EXPECT_EQ_INT(b.error, cur["b"].get_error());
+  }
+  EXPECT_EQ_INT(tinyjson::Parse::MISS_COMMA_OR_SQUARE_BRACKET,
+                tinyjson::Cursor("[1 2]")[1].get_error());
+  tinyjson::Cursor number("[1x]");
+  EXPECT_EQ_INT64(1, number[0].get_int64());
+
+  for (int i = 0; i < 200; i++) {
+    std::string random = random_json(5);
+    tinyjson::Value expect;
+    if (expect.parse(std::make_shared<std::string>(random)) ==
+        tinyjson::Parse::OK)
+      check_cursor(tinyjson::Cursor(random), expect);
+  }
+}
+
+/* Matches of path `p` in `out`, as JSON, to compare them as one string. */
+static std::string projected(tinyjson::Value &out, size_t p) {
+  return out.get_array_elem(p)->stringify();
+}
+
+static void test_projection() {
+  tinyjson::Projection proj;
+  EXPECT_TRUE(!proj.add("meta"));
+  EXPECT_TRUE(!proj.add("/a~2"));
+  EXPECT_TRUE(!proj.add("/a~"));
+  EXPECT_EQ_SIZE_T(0, proj.get_size());
+  EXPECT_TRUE(proj.add("/meta/ts"));
+  EXPECT_TRUE(proj.add("/user/id"));
+  EXPECT_TRUE(proj.add("/items/*/price"));
+  EXPECT_TRUE(proj.add("/items/1"));
+  EXPECT_TRUE(proj.add("/user"));
+  EXPECT_TRUE(proj.add("/a~1b/~0"));
+  EXPECT_TRUE(proj.add("/missing/x"));
+  EXPECT_TRUE(proj.add("/*/*/*"));
+  EXPECT_TRUE(proj.add("/user/id"));
+  EXPECT_EQ_SIZE_T(9, proj.get_size());
+
+  std::string json = "{\"skip\":{\"ts\":[\"]}\\\"\"]},"
+                     "\"items\":[{\"price\":1},{\"price\":2.5,\"x\":[]},"
+                     "{\"qty\":3}],\"meta\":{\"ts\":17},\"a/b\":{\"~\":\"t\"},"
+                     "\"user\":{\"id\":\"u\\u0031\",\"name\":null}}";
+  tinyjson::Value out;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, proj.extract(json, out));
+  EXPECT_EQ_SIZE_T(9, out.get_array_size());
+  EXPECT_TRUE(projected(out, 0) == "[17]");
+  EXPECT_TRUE(projected(out, 1) == "[\"u1\"]");
+  EXPECT_TRUE(projected(out, 2) == "[1,2.5]");
+  EXPECT_TRUE(projected(out, 3) == "[{\"price\":2.5,\"x\":[]}]");
+  EXPECT_TRUE(projected(out, 4) == "[{\"id\":\"u1\",\"name\":null}]");
+  EXPECT_TRUE(projected(out, 5) == "[\"t\"]");
+  EXPECT_TRUE(projected(out, 6) == "[]");
+  EXPECT_TRUE(projected(out, 7) == "[\"]}\\\"\",1,2.5,[],3]");
+  EXPECT_TRUE(projected(out, 8) == projected(out, 1));
+
+  /* the same buffers serve the next document, in an arena this time */
+  tinyjson::Arena arena;
+  tinyjson::Options options;
+  options.arena = &arena;
+  EXPECT_EQ_INT(tinyjson::Parse::OK,
+                proj.extract("{\"user\":{\"id\":7}}", out, options));
+  EXPECT_TRUE(projected(out, 1) == "[7]");
+  EXPECT_TRUE(projected(out, 2) == "[]");
+
+  /* errors on the way are reported, those in skipped values are not */
+  EXPECT_EQ_INT(tinyjson::Parse::EXPECT_VALUE, proj.extract(" ", out));
+  tinyjson::Projection meta;
+  meta.add("/meta");
+  EXPECT_EQ_INT(tinyjson::Parse::OK,
+                meta.extract("{\"skip\":[1,,x],\"meta\":{}}", out));
+  EXPECT_EQ_INT(tinyjson::Parse::MISS_COMMA_OR_CURLY_BRACKET,
+                proj.extract("{\"user\":{\"id\":1 \"x\":2}}", out));
+  EXPECT_EQ_INT(tinyjson::Parse::INVALID_VALUE,
+                proj.extract("{\"items\":[{\"price\":tru}]}", out));
+  EXPECT_EQ_INT(tinyjson::Parse::MISS_COMMA_OR_SQUARE_BRACKET,
+                proj.extract("{\"items\":[{\"price\":1}", out));
+  std::string cut = "{\"items\":[{\"price\":1},{\"price\":2}]}";
+  for (size_t len = 0; len < cut.size(); len++) {
+    std::unique_ptr<char[]> buf(new char[len + 1]);
+    std::memcpy(buf.get(), cut.data(), len);
+    EXPECT_TRUE(proj.extract(buf.get(), len, out) != tinyjson::Parse::OK);
+  }
+
+  /* the root itself and every grandchild, against a full parse */
+  tinyjson::Projection all;
+  all.add("");
+  all.add("/*/*");
+  EXPECT_EQ_INT(tinyjson::Parse::NESTING_TOO_DEEP,
+                all.extract(std::string(2000000, '['), out));
+  options.max_depth = 4;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, all.extract(nested(4), out, options));
+  EXPECT_EQ_INT(tinyjson::Parse::NESTING_TOO_DEEP,
+                all.extract(nested(5), out, options));
+  for (int i = 0; i < 200; i++) {
+    std::string random = random_json(4);
+    tinyjson::Value expect;
+    tinyjson::Parse ret = expect.parse(std::make_shared<std::string>(random));
+    if (ret != tinyjson::Parse::OK)
+      continue;
+    EXPECT_EQ_INT(tinyjson::Parse::OK, all.extract(random, out));
+    EXPECT_TRUE(projected(out, 0) == "[" + expect.stringify() + "]");
+    std::string grandchildren = "[";
+    auto children = [](tinyjson::Value &v, size_t j) {
+      return v.get_type() == tinyjson::Type::ARRAY ? v.get_array_elem(j)
+                                                   : v.get_object_value(j);
+    };
+    auto count = [](tinyjson::Value &v) -> size_t {
+      if (v.get_type() == tinyjson::Type::ARRAY)
+        return v.get_array_size();
+      if (v.get_type() == tinyjson::Type::OBJECT)
+        return v.get_object_size();
+      return 0;
+    };
+    for (size_t j = 0; j < count(expect); j++) {
+      tinyjson::Value *child = children(expect, j);
+      for (size_t k = 0; k < count(*child); k++) {
+        if (grandchildren.size() > 1)
+          grandchildren += ",";
+        grandchildren += children(*child, k)->stringify();
+      }
+    }
+    EXPECT_TRUE(projected(out, 1) == grandchildren + "]");
+  }
+}
+
+static void test_value_ownership() {
+  std::string json = "{\"a\":[1,\"a string past twelve bytes\",{\"b\":null}],"
+                     "\"k\\u0031\":\"x\\ny\",\"n\":-7}";
+  for (bool zero_copy : {false, true}) {
+    tinyjson::Options options;
+    options.zero_copy = zero_copy;
+    tinyjson::Value v;
+    EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse(json, options));
+    std::string expect = v.stringify();
+
+    /* a move hands the tree over and leaves a NIL behind */
+    tinyjson::Value moved(std::move(v));
+    EXPECT_EQ_INT(tinyjson::Type::NIL, v.get_type());
+    EXPECT_TRUE(moved.stringify() == expect);
+    v = std::move(moved);
+    EXPECT_EQ_INT(tinyjson::Type::NIL, moved.get_type());
+    EXPECT_TRUE(v.stringify() == expect);
+
+    /* deep copies share nothing with the original */
+    tinyjson::Value heap, arena_copy;
+    tinyjson::Arena arena;
+    heap.copy(v);
+    arena_copy.copy(v, &arena);
+    EXPECT_TRUE(heap.is_equal(v));
+    v.release();
+    /* escaped zero-copy strings are decoded by the copy */
+    EXPECT_TRUE(zero_copy || heap.stringify() == expect);
+    EXPECT_TRUE(heap.is_equal(arena_copy));
+
+    /* iteration reads the nodes in place */
+    size_t n = 0;
+    for (tinyjson::Value &e : heap.find_member("a")->get_array_elems())
+      EXPECT_TRUE(&e == heap.find_member("a")->get_array_elem(n++));
+    EXPECT_EQ_SIZE_T(3, n);
+    std::string keys;
+    for (tinyjson::Member &m : heap.get_object_members()) {
+      keys += m.get_key_view();
+      EXPECT_TRUE(&m.get_value() == heap.find_member(m.get_key_view()));
+    }
+    EXPECT_TRUE(keys == "ak1n");
+  }
+
+  /* a copy of a wide object gets its own hash index */
+  std::string wide = "{";
+  for (int i = 0; i < 40; i++)
+    wide += (i == 0 ? "\"" : ",\"") + std::to_string(i) + "\":" +
+            std::to_string(i);
+  wide += "}";
+  tinyjson::Value v, copy;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse(wide));
+  copy.copy(v);
+  v.release();
+  EXPECT_EQ_DOUBLE(39.0, copy.find_member("39")->get_number());
+  EXPECT_TRUE(copy.find_member("40") == nullptr);
+
+  /* a member takes over the value it is built from */
+  tinyjson::Value s;
+  s.set_cstring("a string past twelve bytes", 26);
+  tinyjson::Member m("key", std::move(s));
+  EXPECT_EQ_INT(tinyjson::Type::NIL, s.get_type());
+  EXPECT_TRUE(m.get_key_view() == "key");
+  EXPECT_TRUE(m.get_value().get_string_view() == "a string past twelve bytes");
+
+  /* containers move their values when they grow */
+  std::vector<tinyjson::Value> values;
+  for (int i = 0; i < 100; i++) {
+    values.emplace_back();
+    values.back().set_cstring("another string past twelve", 26);
+  }
+  EXPECT_TRUE(values[0].get_string_view() == values[99].get_string_view());
+}
+
+static void test_memory_usage() {
+  tinyjson::Value v;
+  EXPECT_EQ_SIZE_T(sizeof(tinyjson::Value), v.memory_usage());
+  v.set_cstring("inline", 6);
+  EXPECT_EQ_SIZE_T(sizeof(tinyjson::Value), v.memory_usage());
+  v.set_cstring("a string past twelve bytes", 26);
+  EXPECT_EQ_SIZE_T(sizeof(tinyjson::Value) + 26, v.memory_usage());
+
+  std::string json = "[1,\"a string past twelve bytes\",{\"k\":null}]";
+  EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse(json));
+  EXPECT_EQ_SIZE_T(sizeof(tinyjson::Value) * 4 + 26 +
+                       sizeof(tinyjson::Member),
+                   v.memory_usage());
+  /* borrowed strings belong to the input */
+  tinyjson::Options options;
+  options.zero_copy = true;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse(json, options));
+  EXPECT_EQ_SIZE_T(sizeof(tinyjson::Value) * 4 + sizeof(tinyjson::Member),
+                   v.memory_usage());
+}
+
+#ifdef TINYJSON_STATS
+static void test_stats() {
+  std::string json = " {\"a\":[1,2.5,\"a string past twelve bytes\"],"
+                     "\"b\":{\"c\":[[true,false,null]]},\"d\":{}} ";
+  for (int mode = 0; mode < 4; mode++) {
+    tinyjson::Stats stats;
+    tinyjson::Options options;
+    options.stats = &stats;
+    options.engine = mode == 1   ? tinyjson::ENGINE_STRUCTURAL
+                     : mode == 2 ? tinyjson::ENGINE_RECURSIVE
+                                 : tinyjson::ENGINE_ITERATIVE;
+    tinyjson::Arena arena;
+    options.arena = mode == 3 ? &arena : nullptr;
+    tinyjson::Value v;
+    EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse(json, options));
+    EXPECT_EQ_SIZE_T(json.size() - 1, stats.bytes);
+    EXPECT_EQ_SIZE_T(1, stats.nodes[tinyjson::Type::NIL]);
+    EXPECT_EQ_SIZE_T(1, stats.nodes[tinyjson::Type::TRUE]);
+    EXPECT_EQ_SIZE_T(1, stats.nodes[tinyjson::Type::FALSE]);
+    EXPECT_EQ_SIZE_T(2, stats.nodes[tinyjson::Type::NUMBER]);
+    EXPECT_EQ_SIZE_T(1, stats.nodes[tinyjson::Type::STRING]);
+    EXPECT_EQ_SIZE_T(3, stats.nodes[tinyjson::Type::ARRAY]);
+    EXPECT_EQ_SIZE_T(3, stats.nodes[tinyjson::Type::OBJECT]);
+    EXPECT_EQ_SIZE_T(4, stats.max_depth);
+    EXPECT_TRUE(stats.stack_peak > 0);
+    EXPECT_TRUE(stats.stack_grows > 0);
+    EXPECT_TRUE(stats.allocations >= stats.stack_grows);
+    EXPECT_TRUE(stats.string_ns > 0 && stats.number_ns > 0);
+
+    /* a second parse adds to the counts */
+    EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse("[1]", options));
+    EXPECT_EQ_SIZE_T(3, stats.nodes[tinyjson::Type::NUMBER]);
+    EXPECT_EQ_SIZE_T(4, stats.max_depth);
+  }
+
+  /* values before an error are counted once, even when parsed twice */
+  tinyjson::Stats stats;
+  tinyjson::Options options;
+  options.stats = &stats;
+  options.engine = tinyjson::ENGINE_STRUCTURAL;
+  tinyjson::Value v;
+  EXPECT_EQ_INT(tinyjson::Parse::MISS_COMMA_OR_SQUARE_BRACKET,
+                v.parse("[1,2,3 4]", options));
+  EXPECT_EQ_SIZE_T(3, stats.nodes[tinyjson::Type::NUMBER]);
+
+  /* several threads and a batch sum up their counts */
+  std::string big = "[";
+  for (int i = 0; i < 20000; i++)
+    big += i == 0 ? "[1,\"x\"]" : ",[1,\"x\"]";
+  big += "]";
+  for (unsigned threads : {1, 4}) {
+    stats = tinyjson::Stats();
+    options = tinyjson::Options();
+    options.stats = &stats;
+    options.threads = threads;
+    EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse(big, options));
+    EXPECT_EQ_SIZE_T(big.size(), stats.bytes);
+    EXPECT_EQ_SIZE_T(20001, stats.nodes[tinyjson::Type::ARRAY]);
+    EXPECT_EQ_SIZE_T(20000, stats.nodes[tinyjson::Type::STRING]);
+    EXPECT_EQ_SIZE_T(2, stats.max_depth);
+  }
+  stats = tinyjson::Stats();
+  tinyjson::Batch batch;
+  EXPECT_EQ_SIZE_T(1, batch.parse(std::make_shared<std::string>(
+                                      "[1,2]\n{\"a\":[[]]}\n[1 2]"),
+                                  2, options));
+  EXPECT_EQ_SIZE_T(3, stats.nodes[tinyjson::Type::NUMBER]);
+  EXPECT_EQ_SIZE_T(3, stats.max_depth);
+
+  /* parsing the same shape into a recycled tree allocates nothing */
+  tinyjson::Recycler recycler;
+  options.threads = 1;
+  EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse_into(json, recycler, options));
+  stats = tinyjson::Stats();
+  EXPECT_EQ_INT(tinyjson::Parse::OK, v.parse_into(json, recycler, options));
+  EXPECT_EQ_SIZE_T(0, stats.allocations);
+}
+#endif
+
+#define TEST_ROUNDTRIP(json)                                                   \
+  do {                                                                         \
+    tinyjson::Value v;                                                         \
+    EXPECT_EQ_INT(tinyjson::Parse::OK,                                         \
+                  v.parse(std::make_shared<std::string>(std::string(json))));  \
+    std::string out = v.stringify();                                           \
+    EXPECT_EQ_STRING(json, out.c_str(), out.size());                           \
+  } while (0)
+
+static void test_stringify() {
+  TEST_ROUNDTRIP("null");
+  TEST_ROUNDTRIP("false");
+  TEST_ROUNDTRIP("true");
+
+  TEST_ROUNDTRIP("0");
+  TEST_ROUNDTRIP("-0");
+  TEST_ROUNDTRIP("1");
+  TEST_ROUNDTRIP("-1");
+  TEST_ROUNDTRIP("1.5");
+  TEST_ROUNDTRIP("-1.5");
+  TEST_ROUNDTRIP("3.25");
+  TEST_ROUNDTRIP("0.1");
+  TEST_ROUNDTRIP("1e+20");
+  TEST_ROUNDTRIP("1.234e+20");
+  TEST_ROUNDTRIP("1.234e-20");
+  TEST_ROUNDTRIP("-9223372036854775808");
+  TEST_ROUNDTRIP("18446744073709551615");
+  TEST_ROUNDTRIP("1.0000000000000002");
+  TEST_ROUNDTRIP("5e-324");
+  TEST_ROUNDTRIP("2.225073858507201e-308");
+  TEST_ROUNDTRIP("1.7976931348623157e+308");
+
+  TEST_ROUNDTRIP("\"\"");
+  TEST_ROUNDTRIP("\"Hello\"");
+  TEST_ROUNDTRIP("\"Hello\\nWorld\"");
+  TEST_ROUNDTRIP("\"\\\" \\\\ / \\b \\f \\n \\r \\t\"");
+  TEST_ROUNDTRIP("\"Hello\\u0000World\\u001F\"");
+  TEST_ROUNDTRIP("\"\xE2\x82\xAC and a tail longer than one SIMD block\"");
+
+  TEST_ROUNDTRIP("[]");
+  TEST_ROUNDTRIP("[null,false,true,123,\"abc\",[1,2,3]]");
+  TEST_ROUNDTRIP("{}");
+  TEST_ROUNDTRIP("{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"abc\","
+                 "\"a\":[1,2,3],\"o\":{\"1\":1,\"2\":2,\"3\":3}}");
+
+  /* JSON cannot spell these */
+  tinyjson::Value v;
+  v.set_number(INFINITY);
+  EXPECT_TRUE(v.stringify() == "null");
+  v.set_number(NAN);
+  EXPECT_TRUE(v.stringify() == "null");
+
+  /* any double survives the trip */
+  for (int i = 0; i < 1000; i++) {
+    uint64_t bits = (uint64_t)next_rand() << 32 | next_rand();
+    double d;
+    std::memcpy(&d, &bits, sizeof(d));
+    if (!std::isfinite(d))
+      continue;
+    v.set_number(d);
+    tinyjson::Value w;
+    EXPECT_EQ_INT(tinyjson::Parse::OK,
+                  w.parse(std::make_shared<std::string>(v.stringify())));
+    EXPECT_TRUE(w.get_number() == d &&
+                std::signbit(w.get_number()) == std::signbit(d));
+  }
+
+  /* parse(stringify(v)) == v, also for strings still escaped in the input */
+  tinyjson::Options options;
+  options.zero_copy = true;
+  for (int i = 0; i < 200; i++) {
+    auto json = std::make_shared<std::string>(random_json(5));
+    tinyjson::Value a, b, c, d;
+    if (a.parse(json) != tinyjson::Parse::OK)
+      continue;
+    EXPECT_EQ_INT(tinyjson::Parse::OK,
+                  b.parse(std::make_shared<std::string>(a.stringify())));
+    EXPECT_TRUE(a.is_equal(b));
+    EXPECT_EQ_INT(tinyjson::Parse::OK, c.parse(json, options));
+    EXPECT_EQ_INT(tinyjson::Parse::OK,
+                  d.parse(std::make_shared<std::string>(c.stringify())));
+    EXPECT_TRUE(a.is_equal(d));
+  }
+}
+
 static void test_parse() {
   test_parse_null();
   test_parse_expect_value();
   test_parse_number();
+  test_parse_integer();
+  test_parse_number_hard();
   test_parse_number_too_big();
   test_access_string();
   test_getter_and_setter();
@@ -375,10 +2134,37 @@ static void test_parse() {
   test_parse_miss_colon();
   test_parse_miss_comma_or_curly_bracket();
   test_parse_object();
+  test_parse_arena();
+  test_arena_reset();
+  test_parser();
+  test_parse_into();
+  test_binary();
+  test_tape();
+  test_compact_value();
+  test_parse_zero_copy();
+  test_parse_long_string();
+  test_parse_whitespace();
+  test_parse_structural();
+  test_parse_iterative();
+  test_parse_file();
+  test_parse_sax();
+  test_parse_stream();
+  test_parse_lines();
+  test_parse_parallel();
+  test_find_member();
+  test_parse_intern();
+  test_cursor();
+  test_projection();
+  test_value_ownership();
+  test_memory_usage();
+#ifdef TINYJSON_STATS
+  test_stats();
+#endif
 }
 
 int main() {
   test_parse();
+  test_stringify();
 
   if ((test_pass / test_count) < 1) {
     std::printf(F_FYEL "%d/%d (%3.2f%%) passed\n" F_NRM, test_pass, test_count,